@@ -55,6 +55,15 @@
 // Bytes 8-9:   16-bit unsigned integer for msSection1StartOffsetDuration                                       //
 // Bytes 10-11: 16-bit unsigned integer for msSensorToCenterOfRotationDuration                                  //
 // Bytes 12-13: 16-bit unsigned integer for msBetweenPointsDuration                                             //
+// Bytes 14-15: 16-bit unsigned integer for the braking time from calibratedTimingSpeed                         //
+// Bytes 16-17: 16-bit unsigned integer for the braking time from full speed                                    //
+// Bytes 18-25: 16-bit unsigned integers for the rotation rates of the motion model (see MotionModel.h)         //
+// Bytes 26-33: 16-bit unsigned integers for the translation rates of the motion model                          //
+// Bytes 34-50: 8-bit unsigned integers for the response curve of the left motor                                //
+// Bytes 51-67: 8-bit unsigned integers for the response curve of the right motor                               //
+// Bytes 68-76: 8-bit unsigned integers for the spreads of the trials of the motor timings (bytes 0-17)         //
+//                                                                                                              //
+// Bytes 256-767: course maps of sections 1 to 4, 128 bytes each (magic byte, number of segments, segments)     //
 //                                                                                                              //
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -0,0 +1,306 @@
+/// Calibrated model of the rotation and translation speeds of the robot as a function of the duty cycle
+/// \file MotionModel.cpp
+/// \author Misha Krieger-Raynauld (1952515), Simon Gauvin (1951457), Vlad Drelciuc (1941366), Nicolas Charron (1960356)
+/// \date 2019-04-08
+
+#include "MotionModel.h"
+#include "Debug.h"
+#include "ExternalMemory.h"
+#include "GeneralIo.h"
+#include "Motors.h"
+#include "Timer.h"
+
+namespace
+{
+    // EEPROM addresses of the rotation and translation rates, right after the motor timings
+    constexpr uint16_t rotationRatesAddress = 18;
+    constexpr uint16_t translationRatesAddress = rotationRatesAddress + lib::nbMotionModelDutyCycles * sizeof(uint16_t);
+
+    // Rotations during the calibration are measured between two branches of a cross
+    constexpr uint16_t calibrationAngle = 90;
+
+    // Below this duration, the max power pulse would move the robot more than the whole motion, so it is skipped
+    constexpr uint16_t msMinPulsedMotionDuration = 120;
+
+    // Rates at each of the motionModelDutyCycles, in degrees or millimeters per millisecond (see motionModelRateShift)
+    uint16_t rotationRates[lib::nbMotionModelDutyCycles];
+    uint16_t translationRates[lib::nbMotionModelDutyCycles];
+
+    /// Get the rate for an amount covered in a duration
+    /// \param amount     The amount, in degrees or millimeters
+    /// \param msDuration The duration in milliseconds
+    /// \return The rate, see motionModelRateShift
+    uint16_t getRate(uint16_t amount, uint16_t msDuration)
+    {
+        if (msDuration == 0)
+        {
+            return UINT16_MAX;
+        }
+        uint32_t rate = (static_cast<uint32_t>(amount) << lib::motionModelRateShift) / msDuration;
+        return (rate > UINT16_MAX) ? UINT16_MAX : rate;
+    }
+
+    /// Get the rate at a duty cycle, linearly interpolated between the calibrated duty cycles, and extrapolated from the
+    /// closest two outside of them
+    /// \param rates     The rates at each of the motionModelDutyCycles
+    /// \param dutyCycle The duty cycle
+    /// \return The rate, at least 1
+    uint16_t interpolateRate(const uint16_t* rates, uint8_t dutyCycle)
+    {
+        uint8_t index = 0;
+        while (index < lib::nbMotionModelDutyCycles - 2 && dutyCycle > lib::motionModelDutyCycles[index + 1])
+        {
+            index++;
+        }
+
+        int32_t rateDifference = static_cast<int32_t>(rates[index + 1]) - rates[index];
+        int16_t dutyCycleOffset = static_cast<int16_t>(dutyCycle) - lib::motionModelDutyCycles[index];
+        uint8_t dutyCycleDifference = lib::motionModelDutyCycles[index + 1] - lib::motionModelDutyCycles[index];
+        int32_t rate = rates[index] + rateDifference * dutyCycleOffset / dutyCycleDifference;
+
+        if (rate < 1)
+        {
+            return 1;
+        }
+        return (rate > UINT16_MAX) ? UINT16_MAX : rate;
+    }
+
+    /// Get the duration to cover an amount at a rate
+    /// \param amount The amount, in degrees or millimeters
+    /// \param rate   The rate, see motionModelRateShift
+    /// \return The duration in milliseconds
+    uint16_t getDuration(uint16_t amount, uint16_t rate)
+    {
+        uint32_t msDuration = (static_cast<uint32_t>(amount) << lib::motionModelRateShift) / rate;
+        return (msDuration > UINT16_MAX) ? UINT16_MAX : msDuration;
+    }
+
+    /// Hold the duty cycles of a motion for its duration, counted from its start, then force stop the motors
+    /// \param msStart    The time at which the motion started, before its pulse
+    /// \param msDuration The duration of the motion
+    void finishMotion(uint16_t msStart, uint16_t msDuration)
+    {
+        while (static_cast<uint16_t>(lib::getMilliseconds() - msStart) < msDuration)
+        {
+        }
+        lib::forceStopMotors();
+    }
+
+    /// Time a clockwise rotation from a branch of a cross to the next one
+    /// \param dutyCycle The duty cycle of the rotation
+    /// \return The duration of the rotation in milliseconds, pulse included
+    uint16_t timeRotation(uint8_t dutyCycle)
+    {
+        uint16_t msStart = lib::getMilliseconds();
+        lib::pulseMotorsClockwise();
+        lib::setMotorSpeed(dutyCycle, -dutyCycle);
+
+        uint8_t lineTrackerValues;
+        bool hasLeftInitialBlackLine = false;
+        // Loop while the middle sensor is on white or while the line tracker has not at least left its initial branch
+        while (((lineTrackerValues = lib::readLineTrackerValues()) & 0b00100) == 0 || hasLeftInitialBlackLine == false)
+        {
+            if (lineTrackerValues == 0b00000)
+            {
+                hasLeftInitialBlackLine = true;
+            }
+        }
+        uint16_t msDuration = lib::getMilliseconds() - msStart;
+
+        lib::forceStopMotors();
+        return msDuration;
+    }
+
+    /// Time a translation from a standstill to a line 3 inches ahead of the line tracker
+    /// \param dutyCycle The duty cycle of the translation
+    /// \return The duration of the translation in milliseconds, pulse and ramp up included
+    uint16_t timeTranslation(uint8_t dutyCycle)
+    {
+        uint16_t msStart = lib::getMilliseconds();
+        lib::goStraight(dutyCycle);
+
+        // Wait for the three middle sensors to be on the line
+        while ((lib::readLineTrackerValues() & 0b01110) != 0b01110)
+        {
+        }
+        uint16_t msDuration = lib::getMilliseconds() - msStart;
+
+        lib::forceStopMotors();
+        return msDuration;
+    }
+
+    #ifdef DEBUG // In ifdef to avoid unused parameter warning when compiling in release mode
+        /// Print the rates of a model
+        /// \param rates The rates at each of the motionModelDutyCycles
+        void printRates(const uint16_t* rates)
+        {
+            for (uint8_t i = 0; i < lib::nbMotionModelDutyCycles; i++)
+            {
+                DEBUG_PRINT(' ');
+                DEBUG_PRINT_NUMBER(rates[i]);
+            }
+            DEBUG_PRINT('\n');
+        }
+    #endif
+} // namespace
+
+namespace lib
+{
+    void calibrateMotionModel()
+    {
+        DEBUG_PRINT("MOTION MODEL CALIBRATION STARTED\n");
+
+        ExternalMemory memoryInterface;
+
+        // The robot overshoots the branch it stops on, so it is placed back on the cross before each rotation
+        for (uint8_t i = 0; i < nbMotionModelDutyCycles; i++)
+        {
+            DEBUG_PRINT("\tAbout to calibrate rotation at duty cycle ");
+            DEBUG_PRINT_NUMBER(motionModelDutyCycles[i]);
+            DEBUG_PRINT(", please place robot on a cross. Waiting for button press\n");
+            while (isButtonPressed() == false)
+            {
+                readLineTrackerValues(); // Read line tracker values to help with placement
+            }
+            rotationRates[i] = getRate(calibrationAngle, timeRotation(motionModelDutyCycles[i]));
+        }
+
+        for (uint8_t i = 0; i < nbMotionModelDutyCycles; i++)
+        {
+            DEBUG_PRINT("\tAbout to calibrate translation at duty cycle ");
+            DEBUG_PRINT_NUMBER(motionModelDutyCycles[i]);
+            DEBUG_PRINT(", please place robot. Waiting for button press\n");
+            while (isButtonPressed() == false)
+            {
+                readLineTrackerValues(); // Read line tracker values to help with placement
+            }
+            translationRates[i] = getRate(calibrationDistanceMm, timeTranslation(motionModelDutyCycles[i]));
+        }
+
+        // Store calibrated values in EEPROM
+        memoryInterface.write(rotationRatesAddress, reinterpret_cast<const uint8_t*>(rotationRates), sizeof(rotationRates));
+        msSleep(5); // Let the EEPROM finish its write cycle before the next one
+        memoryInterface.write(translationRatesAddress, reinterpret_cast<const uint8_t*>(translationRates), sizeof(translationRates));
+        #ifdef DEBUG
+            DEBUG_PRINT("\tStoring rotation rates:");
+            printRates(rotationRates);
+            DEBUG_PRINT("\tStoring translation rates:");
+            printRates(translationRates);
+        #endif
+
+        DEBUG_PRINT("MOTION MODEL CALIBRATION COMPLETE\n");
+        displayNumberOnTrackerLeds(0);
+
+        msSleep(5); // Sleep for 5 ms to read back from EEPROM properly
+    }
+
+    void readMotionModel()
+    {
+        DEBUG_PRINT("READING MOTION MODEL STARTED\n");
+
+        ExternalMemory memoryInterface;
+        memoryInterface.read(rotationRatesAddress, reinterpret_cast<uint8_t*>(rotationRates), sizeof(rotationRates));
+        memoryInterface.read(translationRatesAddress, reinterpret_cast<uint8_t*>(translationRates), sizeof(translationRates));
+
+        // An erased EEPROM reads as all ones: fall back to speeds proportional to the duty cycle, through the single speed
+        // measured by the motor timings
+        bool isCalibrated = true;
+        for (uint8_t i = 0; i < nbMotionModelDutyCycles; i++)
+        {
+            if (rotationRates[i] == 0 || rotationRates[i] == UINT16_MAX ||
+                translationRates[i] == 0 || translationRates[i] == UINT16_MAX)
+            {
+                isCalibrated = false;
+            }
+        }
+        if (isCalibrated == false)
+        {
+            DEBUG_PRINT("\tMotion model not calibrated, using the motor timings\n");
+            uint16_t msRotate90Duration = (msRotate90ClockwiseDuration + msRotate90CounterclockwiseDuration) / 2;
+            uint16_t rotationRate = getRate(calibrationAngle, msRotate90Duration);
+            uint16_t translationRate = getRate(calibrationDistanceMm, msBetweenPointsDuration);
+            for (uint8_t i = 0; i < nbMotionModelDutyCycles; i++)
+            {
+                rotationRates[i] = static_cast<uint32_t>(rotationRate) * motionModelDutyCycles[i] / calibratedRotationSpeed;
+                translationRates[i] = static_cast<uint32_t>(translationRate) * motionModelDutyCycles[i] / calibratedTimingSpeed;
+            }
+        }
+
+        #ifdef DEBUG
+            DEBUG_PRINT("\tRotation rates:");
+            printRates(rotationRates);
+            DEBUG_PRINT("\tTranslation rates:");
+            printRates(translationRates);
+        #endif
+
+        DEBUG_PRINT("READING MOTION MODEL COMPLETE\n");
+    }
+
+    uint16_t getRotationRate(uint8_t dutyCycle)
+    {
+        return interpolateRate(rotationRates, dutyCycle);
+    }
+
+    uint16_t getTranslationRate(uint8_t dutyCycle)
+    {
+        return interpolateRate(translationRates, dutyCycle);
+    }
+
+    uint16_t getRotationDuration(uint16_t degrees, uint8_t dutyCycle)
+    {
+        return getDuration(degrees, interpolateRate(rotationRates, dutyCycle));
+    }
+
+    uint16_t getTranslationDuration(uint16_t mm, uint8_t dutyCycle)
+    {
+        return getDuration(mm, interpolateRate(translationRates, dutyCycle));
+    }
+
+    void rotateByDegrees(int16_t angle, uint8_t dutyCycle)
+    {
+        bool isClockwise = angle >= 0;
+        uint16_t msDuration = getRotationDuration(isClockwise ? angle : -angle, dutyCycle);
+        if (msDuration == 0)
+        {
+            return;
+        }
+
+        uint16_t msStart = getMilliseconds();
+        if (msDuration >= msMinPulsedMotionDuration)
+        {
+            if (isClockwise)
+            {
+                pulseMotorsClockwise();
+            }
+            else
+            {
+                pulseMotorsCounterclockwise();
+            }
+        }
+        int16_t leftDutyCycle = isClockwise ? dutyCycle : -dutyCycle;
+        setMotorSpeed(leftDutyCycle, -leftDutyCycle);
+        finishMotion(msStart, msDuration);
+    }
+
+    void driveDistance(int16_t mm, uint8_t dutyCycle)
+    {
+        bool isForward = mm >= 0;
+        uint16_t msDuration = getTranslationDuration(isForward ? mm : -mm, dutyCycle);
+        if (msDuration == 0)
+        {
+            return;
+        }
+
+        uint16_t msStart = getMilliseconds();
+        int16_t signedDutyCycle = isForward ? dutyCycle : -dutyCycle;
+        if (msDuration >= msMinPulsedMotionDuration)
+        {
+            goStraight(signedDutyCycle);
+        }
+        else
+        {
+            setMotorSpeed(signedDutyCycle, signedDutyCycle);
+        }
+        finishMotion(msStart, msDuration);
+    }
+} // namespace lib
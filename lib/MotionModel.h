@@ -0,0 +1,71 @@
+/// Calibrated model of the rotation and translation speeds of the robot as a function of the duty cycle
+/// \file MotionModel.h
+/// \author Misha Krieger-Raynauld (1952515), Simon Gauvin (1951457), Vlad Drelciuc (1941366), Nicolas Charron (1960356)
+/// \date 2019-04-08
+
+#ifndef MOTIONMODEL_H
+#define MOTIONMODEL_H
+
+#include <stdint.h>
+
+namespace lib
+{
+    /// Duty cycles at which the model is calibrated. The speeds at the other duty cycles are linearly interpolated between them
+    constexpr uint8_t motionModelDutyCycles[] = {100, 150, 200, 255};
+    constexpr uint8_t nbMotionModelDutyCycles = sizeof(motionModelDutyCycles) / sizeof(motionModelDutyCycles[0]);
+
+    /// Rates of the model are in units per millisecond shifted left by this amount (degrees or millimeters)
+    constexpr uint8_t motionModelRateShift = 14;
+
+    /// Distance from the line tracker to the line used to calibrate translations (3 inches, as between the points of section 1)
+    constexpr uint16_t calibrationDistanceMm = 76;
+
+    /// Run semi-automated tests to calibrate the rotation and translation speeds at each of the motionModelDutyCycles.
+    /// Places the values in external EEPROM after the motor timings, see Config.h.
+    /// Note: for each rotation, needs to be placed on a cross of black lines with its middle line tracker sensor on the outside
+    ///       edge of one of its branches. The robot then rotates clockwise to the next branch.
+    ///       For each translation, needs to be placed with its line tracker 3 inches before the edge of a black line, for
+    ///       example just past another black line. Both are timed from a standstill, so the rates include the pulse and the
+    ///       ramp up of the motors
+    /// Note: in debug mode, requires initializeUsart() to have been called beforehand
+    void calibrateMotionModel();
+
+    /// Read the motion model back from external EEPROM. If it was never calibrated, a model proportional to the duty cycle is
+    /// derived from the motor timings instead, so readMotorTimings must be called beforehand
+    void readMotionModel();
+
+    /// Get the rotation speed of the robot rotating in place at a duty cycle
+    /// \param dutyCycle The duty cycle of the rotation
+    /// \return The rotation speed in degrees per millisecond, see motionModelRateShift
+    uint16_t getRotationRate(uint8_t dutyCycle);
+
+    /// Get the speed of the robot going straight at a duty cycle
+    /// \param dutyCycle The duty cycle of the translation
+    /// \return The speed in millimeters per millisecond, see motionModelRateShift
+    uint16_t getTranslationRate(uint8_t dutyCycle);
+
+    /// Get the time to rotate in place by an angle, including the pulse and the ramp up of the motors
+    /// \param degrees   The angle of the rotation, in degrees
+    /// \param dutyCycle The duty cycle of the rotation
+    /// \return The duration in milliseconds
+    uint16_t getRotationDuration(uint16_t degrees, uint8_t dutyCycle);
+
+    /// Get the time to go straight for a distance, including the pulse and the ramp up of the motors. The model is most
+    /// accurate for distances close to calibrationDistanceMm, as the time lost starting is spread over the calibration distance
+    /// \param mm        The distance, in millimeters
+    /// \param dutyCycle The duty cycle of the translation
+    /// \return The duration in milliseconds
+    uint16_t getTranslationDuration(uint16_t mm, uint8_t dutyCycle);
+
+    /// Rotate in place by an angle at any speed, according to the calibrated model, then force stop the motors
+    /// \param angle     The angle of the rotation in degrees, positive values mean clockwise
+    /// \param dutyCycle The duty cycle of the rotation
+    void rotateByDegrees(int16_t angle, uint8_t dutyCycle);
+
+    /// Go straight for a distance at any speed, according to the calibrated model, then force stop the motors
+    /// \param mm        The distance in millimeters, negative values mean the robot goes in reverse
+    /// \param dutyCycle The duty cycle of the translation
+    void driveDistance(int16_t mm, uint8_t dutyCycle);
+} // namespace lib
+
+#endif // MOTIONMODEL_H
@@ -0,0 +1,134 @@
+/// Benchmark of the controllability of the motors at low speeds in each PWM mode
+/// \file MotorBenchmark.cpp
+/// \author Misha Krieger-Raynauld (1952515), Simon Gauvin (1951457), Vlad Drelciuc (1941366), Nicolas Charron (1960356)
+/// \date 2019-04-08
+
+#include "MotorBenchmark.h"
+#include "Debug.h"
+#include "GeneralIo.h"
+#include "Timer.h"
+
+namespace
+{
+    // Ramp of the duty cycle while looking for the duty cycle at which the robot starts moving
+    constexpr uint8_t msRampStepDuration = 40;
+
+    // Increase of the duty cycle each time the robot stalls before the next line, and time after which it is considered stalled
+    constexpr uint8_t stallDutyCycleIncrease = 4;
+    constexpr uint16_t msStallDuration = 1500;
+
+    // Masks of the edge sensors of the line tracker
+    constexpr uint8_t leftEdgeSensorMask = 0b10000;
+    constexpr uint8_t rightEdgeSensorMask = 0b00001;
+
+    /// Increase a duty cycle without going past full speed
+    /// \param dutyCycle The duty cycle
+    /// \param increase  The increase
+    /// \return The increased duty cycle
+    uint8_t increaseDutyCycle(uint8_t dutyCycle, uint8_t increase)
+    {
+        return (dutyCycle > UINT8_MAX - increase) ? UINT8_MAX : dutyCycle + increase;
+    }
+} // namespace
+
+namespace lib
+{
+    MotorPwmBenchmarkResult benchmarkMotorPwm(MotorPwmMode mode)
+    {
+        MotorPwmBenchmarkResult result{};
+
+        DEBUG_PRINT("\tAbout to benchmark PWM mode ");
+        DEBUG_PRINT_NUMBER(static_cast<uint8_t>(mode));
+        DEBUG_PRINT(", please place robot. Waiting for button press\n");
+        while (isButtonPressed() == false)
+        {
+            readLineTrackerValues(); // Read line tracker values to help with placement
+        }
+
+        MotorPwmMode previousMode = getMotorPwmMode();
+        setMotorPwmMode(mode);
+
+        // Ramp the duty cycle up from a standstill until the line tracker readings change. As the line tracker starts on the
+        // edge of the first line, they change as soon as the robot starts moving
+        uint8_t initialLineTrackerValues = readLineTrackerValues();
+        uint8_t dutyCycle = 0;
+        while (readLineTrackerValues() == initialLineTrackerValues && dutyCycle < UINT8_MAX)
+        {
+            dutyCycle++;
+            setMotorSpeed(dutyCycle, dutyCycle);
+            msSleep(msRampStepDuration);
+        }
+        result.minStartDutyCycle = dutyCycle;
+
+        // Cross the first line
+        while (readLineTrackerValues() != 0)
+        {
+        }
+
+        // Keep going to the next line, speeding up whenever the robot stalls before it
+        uint16_t msStart = getMilliseconds();
+        uint16_t msFirstSensor = 0;
+        bool hasLineArrived = false;
+        uint16_t msLeftEdge = 0;
+        uint16_t msRightEdge = 0;
+        bool hasLeftEdgeArrived = false;
+        bool hasRightEdgeArrived = false;
+        while (hasLeftEdgeArrived == false || hasRightEdgeArrived == false)
+        {
+            uint8_t lineTrackerValues = readLineTrackerValues();
+            uint16_t msNow = getMilliseconds();
+            if (hasLineArrived == false && lineTrackerValues != 0)
+            {
+                msFirstSensor = msNow;
+                hasLineArrived = true;
+            }
+            if (hasLeftEdgeArrived == false && (lineTrackerValues & leftEdgeSensorMask))
+            {
+                msLeftEdge = msNow;
+                hasLeftEdgeArrived = true;
+            }
+            if (hasRightEdgeArrived == false && (lineTrackerValues & rightEdgeSensorMask))
+            {
+                msRightEdge = msNow;
+                hasRightEdgeArrived = true;
+            }
+
+            // Only speed up while no sensor has reached the line, so that the skew is measured at a single duty cycle
+            if (hasLineArrived == false && static_cast<uint16_t>(msNow - msStart) >= msStallDuration && dutyCycle < UINT8_MAX)
+            {
+                dutyCycle = increaseDutyCycle(dutyCycle, stallDutyCycleIncrease);
+                setMotorSpeed(dutyCycle, dutyCycle);
+                msStart = msNow;
+            }
+        }
+        forceStopMotors();
+
+        result.minStableDutyCycle = dutyCycle;
+        result.msCrossingDuration = msFirstSensor - msStart;
+        result.msSkewDuration = static_cast<int16_t>(msRightEdge - msLeftEdge);
+
+        setMotorPwmMode(previousMode);
+
+        DEBUG_PRINT("\tMin start duty cycle: ");
+        DEBUG_PRINT_NUMBER(result.minStartDutyCycle);
+        DEBUG_PRINT(", min stable duty cycle: ");
+        DEBUG_PRINT_NUMBER(result.minStableDutyCycle);
+        DEBUG_PRINT(", crossing: ");
+        DEBUG_PRINT_NUMBER(result.msCrossingDuration);
+        DEBUG_PRINT(" ms, skew: ");
+        DEBUG_PRINT_NUMBER(result.msSkewDuration);
+        DEBUG_PRINT(" ms\n");
+
+        return result;
+    }
+
+    void benchmarkAllMotorPwmModes()
+    {
+        DEBUG_PRINT("MOTOR PWM BENCHMARK STARTED\n");
+        for (uint8_t i = 0; i < nbMotorPwmModes; i++)
+        {
+            benchmarkMotorPwm(static_cast<MotorPwmMode>(i));
+        }
+        DEBUG_PRINT("MOTOR PWM BENCHMARK COMPLETE\n");
+    }
+} // namespace lib
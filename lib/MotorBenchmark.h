@@ -0,0 +1,38 @@
+/// Benchmark of the controllability of the motors at low speeds in each PWM mode
+/// \file MotorBenchmark.h
+/// \author Misha Krieger-Raynauld (1952515), Simon Gauvin (1951457), Vlad Drelciuc (1941366), Nicolas Charron (1960356)
+/// \date 2019-04-08
+
+#ifndef MOTORBENCHMARK_H
+#define MOTORBENCHMARK_H
+
+#include <stdint.h>
+#include "Motors.h"
+
+namespace lib
+{
+    /// Low speed controllability of the motors in a PWM mode
+    struct MotorPwmBenchmarkResult
+    {
+        uint8_t minStartDutyCycle; // Lowest duty cycle, ramped up from a standstill, at which the robot started moving
+        uint8_t minStableDutyCycle; // Lowest duty cycle at which the robot then reached the next line without stalling
+        uint16_t msCrossingDuration; // Time to reach the next line at the stable duty cycle
+        int16_t msSkewDuration; // Time between the edge sensors reaching the next line, positive when the left one was first (drifting right)
+    };
+
+    /// Measure the low speed controllability of the motors in a PWM mode, with the robot going straight without a pulse.
+    /// The PWM mode is left as it was before the benchmark.
+    /// Note: needs to be placed perpendicular to a black line with its line tracker on the far edge of it, so that the readings
+    ///       change as soon as the robot moves, after which there is 3 inches before the edge of another black line.
+    ///       Waits for a button press before starting
+    /// Note: in debug mode, requires initializeUsart() to have been called beforehand to print the results
+    /// \param mode The PWM mode to measure
+    /// \return The results of the benchmark
+    MotorPwmBenchmarkResult benchmarkMotorPwm(MotorPwmMode mode);
+
+    /// Run benchmarkMotorPwm in every PWM mode, one after the other
+    /// Note: in debug mode, requires initializeUsart() to have been called beforehand to print the results
+    void benchmarkAllMotorPwmModes();
+} // namespace lib
+
+#endif // MOTORBENCHMARK_H
@@ -4,233 +4,911 @@
 /// \date 2019-02-20
 
 #include "Motors.h"
+#include <avr/interrupt.h>
 #include <avr/io.h>
 #include "Config.h"
 #include "Debug.h"
 #include "ExternalMemory.h"
 #include "GeneralIo.h"
+#include "Odometry.h"
 #include "Timer.h"
 
 namespace
 {
     // Number of calibration tests;
-    constexpr uint8_t nbCalibrationTests = 7;
+    constexpr uint8_t nbCalibrationTests = 9;
+
+    // Number of trials of each calibration test, placing the robot for each of them or running the calibration sheet
+    // once per trial. A majority of them must agree with their median
+    constexpr uint8_t nbCalibrationTrials = 5;
+    constexpr uint8_t nbCalibrationSheetTrials = 3;
+    static_assert(nbCalibrationSheetTrials <= nbCalibrationTrials, "The trials of the calibration sheet must fit with the others");
+
+    // Check that the curvatures of the tightest and widest turns do not overflow
+    static_assert(lib::getCurvature(0) == INT16_MAX && lib::getCurvature(2) == INT16_MAX && lib::getCurvature(-2) == -INT16_MAX &&
+                  lib::getCurvature(lib::minCurvatureRadiusMm) == 21845 && lib::getCurvature(INT16_MAX) == 2 &&
+                  lib::getCurvature(INT16_MIN) == -2,
+                  "Unexpected curvature of the tightest or widest turns");
+
+    // EEPROM address of the spreads of the calibration tests, after the response curves of the motors (see Config.h)
+    constexpr uint16_t calibrationSpreadsAddress = 68;
 
     // Timings for slight rotations (set by calibrateMotorTimings)
     uint16_t msRotateSlightlyClockwiseDuration;
     uint16_t msRotateSlightlyCounterclockwiseDuration;
     uint8_t msForceStopAfterRotateSlightlyDuration = 50;
 
+    /// Timer2 settings of a motor PWM mode
+    struct MotorPwmSettings
+    {
+        uint8_t waveGenerationBits; // WGM2 bits of TCCR2A
+        uint8_t clockSelectBits; // CS2 bits of TCCR2B
+    };
+
+    // Settings of each of the motor PWM modes, indexed by lib::MotorPwmMode
+    constexpr MotorPwmSettings motorPwmSettings[lib::nbMotorPwmModes] = {
+        {1 << WGM20, (1 << CS22) | (1 << CS21)}, // Phase-correct, clock divided by 256 (CS2 bits to 110)
+        {1 << WGM20, 1 << CS22}, // Phase-correct, clock divided by 64 (CS2 bits to 100)
+        {1 << WGM20, (1 << CS21) | (1 << CS20)}, // Phase-correct, clock divided by 32 (CS2 bits to 011)
+        {1 << WGM20, 1 << CS21}, // Phase-correct, clock divided by 8 (CS2 bits to 010)
+        {(1 << WGM21) | (1 << WGM20), 1 << CS21}, // Fast, clock divided by 8 (CS2 bits to 010)
+        {(1 << WGM21) | (1 << WGM20), 1 << CS20} // Fast, clock not divided (CS2 bits to 001)
+    };
+
+    lib::MotorPwmMode motorPwmMode = lib::defaultMotorPwmMode;
+
     // Duration of max power pulse for pulse functions
     constexpr uint8_t msMaxPulseDuration = 60;
 
-    constexpr int8_t rightMotorNerfNumerator = 24;
-    constexpr int8_t rightMotorNerfDenominator = 25;
-} // namespace
+    // Braking model (set by calibrateMotorTimings): time for the reversed duty cycle to stop the robot when going straight at
+    // calibratedTimingSpeed and at full speed. The braking time is interpolated between them, and from zero at a standstill
+    uint16_t msBrakeFromTimingSpeedDuration = UINT8_MAX;
+    uint16_t msBrakeFromFullSpeedDuration = UINT8_MAX;
 
-namespace lib
-{
-    // Global variable timings for 90 degree rotations (set by calibrateMotorRotationTimings)
-    uint16_t msRotate90ClockwiseDuration;
-    uint16_t msRotate90CounterclockwiseDuration;
+    // Total time spent in forced stops and number of forced stops, see getStopDuration
+    uint16_t msStopDuration = 0;
+    uint16_t nbStops = 0;
 
-    // Global variable timings for section 1 blind movement
-    uint16_t msSection1StartOffsetDuration;
-    uint16_t msSensorToCenterOfRotationDuration;
-    uint16_t msBetweenPointsDuration;
+    /// Get the time for the reversed duty cycles to stop the robot according to the calibrated braking model
+    /// \param leftDutyCycle  Duty cycle of the left motor
+    /// \param rightDutyCycle Duty cycle of the right motor
+    /// \return The braking time in milliseconds, from the fastest motor
+    uint8_t getBrakingDuration(int16_t leftDutyCycle, int16_t rightDutyCycle)
+    {
+        uint8_t leftSpeed = (leftDutyCycle < 0) ? -leftDutyCycle : leftDutyCycle;
+        uint8_t rightSpeed = (rightDutyCycle < 0) ? -rightDutyCycle : rightDutyCycle;
+        uint8_t speed = (leftSpeed > rightSpeed) ? leftSpeed : rightSpeed;
 
-    void initializeMotors()
-    {        
-        // Timer counter control register flags (2x8 bits)
-        TCCR2A |= (1 << WGM20); // Set wave generation mode to phase-correct 8-bit (0xFF TOP value) PWM by setting WGM2 bits to 001 (two LSBs on TCCR2A and MSB on TCCR2B)
-        TCCR2A |= (1 << COM2A1); // Set compare output mode to clear OC2A on compare match when up-counting and vice-versa by setting COM2A bits to 10
-        TCCR2A |= (1 << COM2B1); // Set compare output mode to clear OC2B on compare match when up-counting and vice-versa by setting COM2B bits to 10
-        TCCR2B |= (1 << CS22) | (1 << CS21); // Set clock select to clock divided by 256 by setting CS2 bits to 110
+        int32_t msDuration;
+        if (speed <= lib::calibratedTimingSpeed)
+        {
+            msDuration = static_cast<int32_t>(speed) * msBrakeFromTimingSpeedDuration / lib::calibratedTimingSpeed;
+        }
+        else
+        {
+            int32_t msDurationDifference = static_cast<int32_t>(msBrakeFromFullSpeedDuration) - msBrakeFromTimingSpeedDuration;
+            msDuration = msBrakeFromTimingSpeedDuration +
+                         msDurationDifference * (speed - lib::calibratedTimingSpeed) / (UINT8_MAX - lib::calibratedTimingSpeed);
+        }
+
+        if (msDuration < 0)
+        {
+            return 0;
+        }
+        return (msDuration > UINT8_MAX) ? UINT8_MAX : msDuration;
     }
 
-    void calibrateMotorTimings()
+    /// Add a forced stop to the total time spent stopping
+    /// \param msDuration The duration of the forced stop
+    void recordStop(uint16_t msDuration)
     {
-        DEBUG_PRINT("CALIBRATION STARTED\n");
+        msStopDuration += msDuration;
+        nbStops++;
+    }
 
-        ExternalMemory memoryInterface;
+    // Response curves of the motors: duty cycle to apply to each motor for every sixteenth of the requested duty cycle,
+    // so that both wheels turn at the same speed when given the same duty cycle. The last point is for a requested 256
+    constexpr uint8_t dutyCycleCurveShift = 4;
+    constexpr uint8_t nbDutyCycleCurvePoints = (256 >> dutyCycleCurveShift) + 1;
 
-        // Calculate calibration values
-        for (uint8_t i = 0; i < nbCalibrationTests; i++)
+    /// Duty cycles to apply at each point of a response curve
+    struct DutyCycleCurve
+    {
+        uint8_t dutyCycles[nbDutyCycleCurvePoints];
+    };
+
+    /// Generate a response curve which scales the requested duty cycle by a constant factor
+    /// \param numerator   The numerator of the factor
+    /// \param denominator The denominator of the factor
+    /// \return The generated curve
+    constexpr DutyCycleCurve makeDutyCycleCurve(uint8_t numerator, uint8_t denominator)
+    {
+        DutyCycleCurve curve{};
+        for (uint8_t i = 0; i < nbDutyCycleCurvePoints; i++)
         {
-            // Wait for button press
-            DEBUG_PRINT("\tAbout to calibrate ");
-            switch (i)
+            uint16_t dutyCycle = (i << dutyCycleCurveShift) * numerator / denominator;
+            curve.dutyCycles[i] = (dutyCycle > UINT8_MAX) ? UINT8_MAX : dutyCycle;
+        }
+        return curve;
+    }
+
+    // Curves used until calibrateMotorCurves is run: experimentally, the right motor is stronger than the left one
+    constexpr DutyCycleCurve defaultLeftMotorCurve = makeDutyCycleCurve(1, 1);
+    constexpr DutyCycleCurve defaultRightMotorCurve = makeDutyCycleCurve(24, 25);
+
+    // Response curves of the motors (set by calibrateMotorCurves)
+    DutyCycleCurve leftMotorCurve = defaultLeftMotorCurve;
+    DutyCycleCurve rightMotorCurve = defaultRightMotorCurve;
+
+    /// Get the duty cycle to apply to a motor for a requested duty cycle, linearly interpolated between the points of its curve
+    /// \param curve     The response curve of the motor
+    /// \param dutyCycle The requested duty cycle
+    /// \return The duty cycle to apply
+    uint8_t applyDutyCycleCurve(const DutyCycleCurve& curve, uint8_t dutyCycle)
+    {
+        // The last point stands for 256, so full speed would otherwise fall just short of it
+        if (dutyCycle == UINT8_MAX)
+        {
+            return curve.dutyCycles[nbDutyCycleCurvePoints - 1];
+        }
+
+        uint8_t index = dutyCycle >> dutyCycleCurveShift;
+        uint8_t fraction = dutyCycle & ((1 << dutyCycleCurveShift) - 1);
+        int16_t dutyCycleDifference = curve.dutyCycles[index + 1] - curve.dutyCycles[index];
+        return curve.dutyCycles[index] + ((dutyCycleDifference * fraction) >> dutyCycleCurveShift);
+    }
+
+    // EEPROM addresses of the response curves, after the motion model (see Config.h)
+    constexpr uint16_t leftMotorCurveAddress = 34;
+    constexpr uint16_t rightMotorCurveAddress = leftMotorCurveAddress + sizeof(DutyCycleCurve);
+
+    // First point of the curves calibrated by driving, as the motors barely turn below it, and time spent at each point
+    constexpr uint8_t firstCalibratedCurvePoint = 4;
+    constexpr uint16_t msCurveCalibrationStepDuration = 200;
+
+    // Duty cycle difference steering the robot back towards the line during the calibration, per sensor of error
+    constexpr uint8_t curveCalibrationSteeringGain = 8;
+
+    // Maximum duty cycle reduction of the stronger motor, in sixteenths
+    constexpr int16_t maxCurveCalibrationTrim = 64 << 4;
+
+    /// Get whether a response curve read from EEPROM is usable: starting from zero and never decreasing
+    /// \param curve The response curve
+    /// \return Whether the curve is valid
+    bool isDutyCycleCurveValid(const DutyCycleCurve& curve)
+    {
+        if (curve.dutyCycles[0] != 0)
+        {
+            return false;
+        }
+        for (uint8_t i = 1; i < nbDutyCycleCurvePoints; i++)
+        {
+            if (curve.dutyCycles[i] < curve.dutyCycles[i - 1])
             {
-            case 0:
-                DEBUG_PRINT("clockwise 90 degree rotation");
-                break;
-            case 1:
-                DEBUG_PRINT("counterclockwise 90 degree rotation");
-                break;
-            case 2:
-                DEBUG_PRINT("slight clockwise rotation");
-                break;
-            case 3:
-                DEBUG_PRINT("slight counterclockwise rotation");
-                break;
-            case 4:
-                DEBUG_PRINT("section 1 start offset");
-                break;
-            case 5:
-                DEBUG_PRINT("sensor to center of rotation");
-                break;
-            case 6:
-                DEBUG_PRINT("distance between points");
-                break;
+                return false;
             }
-            DEBUG_PRINT(" timing, please place robot. Waiting for button press\n");
-            
-            while (isButtonPressed() == false)
+        }
+        return true;
+    }
+
+    /// Get a coarse error of the line under the line tracker for the calibration of the curves
+    /// \param lineTrackerValues The line tracker sensor readings
+    /// \return The number of sensors on black left of the middle minus the number right of it (positive when the robot drifts right)
+    int8_t getCurveCalibrationError(uint8_t lineTrackerValues)
+    {
+        return ((lineTrackerValues >> 4) & 1) + ((lineTrackerValues >> 3) & 1) - ((lineTrackerValues >> 1) & 1) - (lineTrackerValues & 1);
+    }
+
+    /// Follow a straight line at a duty cycle while finding how much the stronger motor must be slowed down to go straight
+    /// \param dutyCycle The duty cycle of both motors
+    /// \param trim      The reduction of the left duty cycle in sixteenths, negative when the right one is reduced instead.
+    ///                  Starts from the given value and is updated every millisecond
+    /// \param meanTrim  The mean reduction in duty cycle over the second half of the step, once the robot settled
+    /// \return Whether the line was followed until the end of the step
+    bool measureCurveTrim(uint8_t dutyCycle, int16_t& trim, int16_t& meanTrim)
+    {
+        int32_t trimSum = 0;
+        uint16_t nbSamples = 0;
+        uint16_t msStart = lib::getMilliseconds();
+        uint16_t msLastUpdate = msStart;
+
+        uint16_t msElapsed;
+        while ((msElapsed = lib::getMilliseconds() - msStart) < msCurveCalibrationStepDuration)
+        {
+            if (lib::getMilliseconds() == msLastUpdate)
             {
-                readLineTrackerValues(); // Read line tracker values to help with placement
+                continue;
             }
+            msLastUpdate = lib::getMilliseconds();
 
-            // Timing counter for the durations
-            uint16_t msTiming = 0;
+            uint8_t lineTrackerValues = lib::readLineTrackerValues();
+            if (lineTrackerValues == 0)
+            {
+                return false;
+            }
 
-            // Calibrate clockwise rotation
-            if (i == 0 || i == 2)
+            // The robot drifting right means the left motor is stronger
+            int8_t error = getCurveCalibrationError(lineTrackerValues);
+            trim += error;
+            if (trim > maxCurveCalibrationTrim)
             {
-                pulseMotorsClockwise();
-                setMotorSpeed(calibratedRotationSpeed, -calibratedRotationSpeed);
+                trim = maxCurveCalibrationTrim;
             }
-            // Calibrate counterclockwise rotation
-            else if (i == 1 || i == 3)
+            else if (trim < -maxCurveCalibrationTrim)
             {
-                pulseMotorsCounterclockwise();
-                setMotorSpeed(-calibratedRotationSpeed, calibratedRotationSpeed);
+                trim = -maxCurveCalibrationTrim;
             }
-            // Straight line calibration timings
-            else
+
+            int16_t dutyCycleTrim = trim >> 4;
+            int16_t steering = error * curveCalibrationSteeringGain;
+            int16_t leftDutyCycle = dutyCycle - ((dutyCycleTrim > 0) ? dutyCycleTrim : 0) - steering;
+            int16_t rightDutyCycle = dutyCycle - ((dutyCycleTrim < 0) ? -dutyCycleTrim : 0) + steering;
+            lib::setMotorSpeed(leftDutyCycle, rightDutyCycle);
+
+            if (msElapsed >= msCurveCalibrationStepDuration / 2)
             {
-                goStraight(calibratedTimingSpeed);
+                trimSum += dutyCycleTrim;
+                nbSamples++;
             }
+        }
+
+        meanTrim = (nbSamples == 0) ? 0 : trimSum / nbSamples;
+        return true;
+    }
+
+    // Integral of the average duty cycle up to the last call to setMotorSpeed, for getDutyCycleIntegral
+    int32_t dutyCycleIntegral = 0;
+    int16_t averageDutyCycle = 0;
+    uint16_t msLastMotorSpeedChange = 0;
+
+    /// Add the duration since the last call to the duty cycle integral and start integrating a new average duty cycle
+    /// \param newAverageDutyCycle The average duty cycle that starts being applied
+    void updateDutyCycleIntegral(int16_t newAverageDutyCycle)
+    {
+        uint16_t msNow = lib::getMilliseconds();
+        dutyCycleIntegral += static_cast<int32_t>(averageDutyCycle) * static_cast<uint16_t>(msNow - msLastMotorSpeedChange);
+        msLastMotorSpeedChange = msNow;
+        averageDutyCycle = newAverageDutyCycle;
+    }
+
+    /// Kinds of motions executed by the motion queue
+    enum class MotionType : uint8_t
+    {
+        SetSpeed, // Set the duty cycles of the motion
+        Reverse // Set the opposite of the duty cycles when the motion starts, to brake
+    };
+
+    /// Motion executed by the motion queue, which holds the duty cycles for a duration before starting the next motion
+    struct Motion
+    {
+        MotionType type;
+        int16_t leftDutyCycle;
+        int16_t rightDutyCycle;
+        uint16_t msDuration;
+    };
+
+    // Motions waiting to be executed by the tick ISR, in a circular buffer
+    constexpr uint8_t motionQueueCapacity = 8;
+    Motion motionQueue[motionQueueCapacity];
+    volatile uint8_t motionQueueHead = 0;
+    volatile uint8_t nbQueuedMotions = 0;
+    volatile uint16_t msMotionRemaining = 0;
+
+    // Maximum changes of the duty cycles per millisecond when accelerating and braking, or 0 for no limit (see setMotorSlewRates)
+    volatile uint8_t maxAccelerationStep = 0;
+    volatile uint8_t maxBrakingStep = 0;
+
+    // Duty cycles requested by the program or the motion queue, and duty cycles applied to the motors, which the slew rate
+    // limiter moves towards the requested ones on every tick
+    volatile int16_t leftTargetDutyCycle = 0;
+    volatile int16_t rightTargetDutyCycle = 0;
+    volatile int16_t leftAppliedDutyCycle = 0;
+    volatile int16_t rightAppliedDutyCycle = 0;
+
+    /// Apply duty cycles to the motors right away
+    /// \param leftDutyCycle  Duty cycle of the left motor, between -255 and 255
+    /// \param rightDutyCycle Duty cycle of the right motor, between -255 and 255
+    void writeMotorDutyCycles(int16_t leftDutyCycle, int16_t rightDutyCycle)
+    {
+        leftAppliedDutyCycle = leftDutyCycle;
+        rightAppliedDutyCycle = rightDutyCycle;
+
+        // Integrate the previous duty cycles before they are replaced
+        updateDutyCycleIntegral((leftDutyCycle + rightDutyCycle) / 2);
+        lib::setOdometryDutyCycles(leftDutyCycle, rightDutyCycle);
+
+        // Reverse direction pin if duty cycle value is below 0 and invert if negative to set duty cycle to OCR2 registers
+        if (leftDutyCycle < 0)
+        {
+            PORTD |= static_cast<uint8_t>(lib::Motor::LeftMotorDirection);
+            leftDutyCycle = -leftDutyCycle;
+        }
+        else
+        {
+            PORTD &= ~static_cast<uint8_t>(lib::Motor::LeftMotorDirection);
+        }
+        
+        if (rightDutyCycle < 0)
+        {
+            PORTD |= static_cast<uint8_t>(lib::Motor::RightMotorDirection);
+            rightDutyCycle = -rightDutyCycle;
+        }
+        else
+        {
+            PORTD &= ~static_cast<uint8_t>(lib::Motor::RightMotorDirection);
+        }
+
+        // Compensate for the difference between the motors
+        leftDutyCycle = applyDutyCycleCurve(leftMotorCurve, leftDutyCycle);
+        rightDutyCycle = applyDutyCycleCurve(rightMotorCurve, rightDutyCycle);
+        
+        // Set duty cycles to OCR2 registers
+        // Important! OC2B is left, OC2A is right (see Config.h)
+        OCR2A = rightDutyCycle;
+        OCR2B = leftDutyCycle;        
+    }
+
+    /// Move an applied duty cycle towards its target within the slew rate limits
+    /// \param dutyCycle        The applied duty cycle
+    /// \param targetDutyCycle  The requested duty cycle
+    /// \return The duty cycle to apply for the next millisecond
+    int16_t slewDutyCycle(int16_t dutyCycle, int16_t targetDutyCycle)
+    {
+        // Moving towards zero brakes, moving away from zero accelerates
+        bool isBraking = (dutyCycle > 0 && targetDutyCycle < dutyCycle) || (dutyCycle < 0 && targetDutyCycle > dutyCycle);
+        int16_t maxStep = isBraking ? maxBrakingStep : maxAccelerationStep;
+        if (maxStep == 0)
+        {
+            return targetDutyCycle;
+        }
 
-            uint8_t lineTrackerValues;
+        // When reversing, brake down to zero first and then accelerate in the other direction
+        if (isBraking && (dutyCycle > 0) != (targetDutyCycle > 0) && targetDutyCycle != 0)
+        {
+            targetDutyCycle = 0;
+        }
+
+        int16_t difference = targetDutyCycle - dutyCycle;
+        if (difference > maxStep)
+        {
+            return dutyCycle + maxStep;
+        }
+        if (difference < -maxStep)
+        {
+            return dutyCycle - maxStep;
+        }
+        return targetDutyCycle;
+    }
 
-            // If calibrating 90 degree rotations
-            if (i < 2)
+    /// Request duty cycles for the motors, see lib::setMotorSpeed. They are applied right away without slew rate limits,
+    /// and reached by the tick ISR otherwise. Does not cancel the queued motions, for use by the motion queue
+    /// \param leftDutyCycle  Duty cycle of the left motor (clamped between -255 and 255)
+    /// \param rightDutyCycle Duty cycle of the right motor (clamped between -255 and 255)
+    void applyMotorSpeed(int16_t leftDutyCycle, int16_t rightDutyCycle)
+    {
+        // Clamp left wheel duty cycle values between -255 and 255
+        if (leftDutyCycle < -UINT8_MAX)
+        {
+            leftDutyCycle = -UINT8_MAX;
+        }
+        else if (leftDutyCycle > UINT8_MAX)
+        {
+            leftDutyCycle = UINT8_MAX;
+        }
+        
+        // Clamp right wheel duty cycle values between -255 and 255
+        if (rightDutyCycle < -UINT8_MAX)
+        {
+            rightDutyCycle = -UINT8_MAX;
+        }
+        else if (rightDutyCycle > UINT8_MAX)
+        {
+            rightDutyCycle = UINT8_MAX;
+        }
+
+        // Restore the global interrupt flag instead of setting it, as the motion queue requests duty cycles from the tick ISR
+        uint8_t sreg = SREG;
+        cli(); // Clear global interrupt flag so that the tick ISR sees both targets at once
+
+        leftTargetDutyCycle = leftDutyCycle;
+        rightTargetDutyCycle = rightDutyCycle;
+        if (maxAccelerationStep == 0 && maxBrakingStep == 0)
+        {
+            writeMotorDutyCycles(leftDutyCycle, rightDutyCycle);
+        }
+
+        SREG = sreg;
+    }
+
+    /// Add motions at the end of the motion queue, either all of them or none of them
+    /// \param motions     The motions to add, in order
+    /// \param nbMotions   The number of motions to add
+    /// \return Whether there was room for the motions
+    bool queueMotions(const Motion* motions, uint8_t nbMotions)
+    {
+        // Move the pose with the current duty cycles before the queue changes them
+        lib::pollOdometry();
+
+        cli(); // Clear global interrupt flag to disable interrupts
+
+        bool hasRoom = nbQueuedMotions + nbMotions <= motionQueueCapacity;
+        if (hasRoom)
+        {
+            uint8_t index = motionQueueHead + nbQueuedMotions;
+            for (uint8_t i = 0; i < nbMotions; i++)
             {
-                bool hasLeftInitialBlackLine = false;
-                // Loop while sensors the middle sensor is on white or while the line tracker has not at least left its initial position on the black line
-                while (((lineTrackerValues = readLineTrackerValues()) & 0b00100) == 0 || hasLeftInitialBlackLine == false)
+                // Wrap around without a modulo, which is costly on 8-bit microcontrollers
+                if (index >= motionQueueCapacity)
                 {
-                    // Set hasLeftInitialBlackLine if all sensors are on white
-                    if (lineTrackerValues == 0b00000)
-                    {
-                        hasLeftInitialBlackLine = true;
-                    }
-
-                    static constexpr uint8_t msTimerIncrements = 50;
-                    msSleep(msTimerIncrements);
-                    msTiming += msTimerIncrements;
+                    index -= motionQueueCapacity;
                 }
-                forceStopMotors(msForceStopAfterRotate90Duration);
+                motionQueue[index++] = motions[i];
             }
-            // If calibrating slight rotations
-            else if (i < 4)
+            nbQueuedMotions += nbMotions;
+        }
+
+        sei(); // Set global interrupt flag to enable interrupts
+        return hasRoom;
+    }
+
+    /// Execute the motion queue. Called by the tick ISR every millisecond
+    void updateMotionQueue()
+    {
+        if (msMotionRemaining > 0 && --msMotionRemaining > 0)
+        {
+            return;
+        }
+        if (nbQueuedMotions == 0)
+        {
+            return;
+        }
+
+        // Start the next motion
+        const Motion& motion = motionQueue[motionQueueHead];
+        if (motion.type == MotionType::Reverse)
+        {
+            applyMotorSpeed(-lib::getLeftMotorSpeed(), -lib::getRightMotorSpeed());
+        }
+        else
+        {
+            applyMotorSpeed(motion.leftDutyCycle, motion.rightDutyCycle);
+        }
+        msMotionRemaining = motion.msDuration;
+
+        if (++motionQueueHead == motionQueueCapacity)
+        {
+            motionQueueHead = 0;
+        }
+        nbQueuedMotions--;
+    }
+
+    /// Move the applied duty cycles towards the requested ones. Called by the tick ISR every millisecond
+    void updateSlewRate()
+    {
+        if (leftAppliedDutyCycle != leftTargetDutyCycle || rightAppliedDutyCycle != rightTargetDutyCycle)
+        {
+            writeMotorDutyCycles(slewDutyCycle(leftAppliedDutyCycle, leftTargetDutyCycle),
+                                 slewDutyCycle(rightAppliedDutyCycle, rightTargetDutyCycle));
+        }
+    }
+
+    /// Update the motors on every millisecond tick
+    void updateMotors()
+    {
+        updateMotionQueue();
+        updateSlewRate();
+        lib::updateOdometry();
+    }
+
+    /// Print the name of a calibration test
+    /// \param test The index of the test
+    void printCalibrationTestName(uint8_t test)
+    {
+        switch (test)
+        {
+        case 0:
+            DEBUG_PRINT("clockwise 90 degree rotation");
+            break;
+        case 1:
+            DEBUG_PRINT("counterclockwise 90 degree rotation");
+            break;
+        case 2:
+            DEBUG_PRINT("slight clockwise rotation");
+            break;
+        case 3:
+            DEBUG_PRINT("slight counterclockwise rotation");
+            break;
+        case 4:
+            DEBUG_PRINT("section 1 start offset");
+            break;
+        case 5:
+            DEBUG_PRINT("sensor to center of rotation");
+            break;
+        case 6:
+            DEBUG_PRINT("distance between points");
+            break;
+        case 7:
+            DEBUG_PRINT("braking from timing speed");
+            break;
+        case 8:
+            DEBUG_PRINT("braking from full speed");
+            break;
+        }
+    }
+
+    /// Run a trial of a calibration test, see lib::calibrateMotorTimings for the placement of the robot
+    /// \param test The index of the test
+    /// \return The measured timing in milliseconds
+    uint16_t runCalibrationTest(uint8_t test)
+    {
+        // Calibrate clockwise rotation
+        if (test == 0 || test == 2)
+        {
+            lib::pulseMotorsClockwise();
+            lib::setMotorSpeed(lib::calibratedRotationSpeed, -lib::calibratedRotationSpeed);
+        }
+        // Calibrate counterclockwise rotation
+        else if (test == 1 || test == 3)
+        {
+            lib::pulseMotorsCounterclockwise();
+            lib::setMotorSpeed(-lib::calibratedRotationSpeed, lib::calibratedRotationSpeed);
+        }
+        // Straight line calibration timings, at full speed for the last braking test
+        else
+        {
+            lib::goStraight((test == 8) ? UINT8_MAX : lib::calibratedTimingSpeed);
+        }
+
+        // Time with the real clock from the end of the pulse
+        uint16_t msStart = lib::getMilliseconds();
+        uint8_t lineTrackerValues;
+
+        // If calibrating 90 degree rotations
+        if (test < 2)
+        {
+            bool hasLeftInitialBlackLine = false;
+            // Loop while sensors the middle sensor is on white or while the line tracker has not at least left its initial position on the black line
+            while (((lineTrackerValues = lib::readLineTrackerValues()) & 0b00100) == 0 || hasLeftInitialBlackLine == false)
             {
-                uint8_t lineTrackerMask = (i == 2) ? 0b10000 : 0b00001; // CW for first test (i == 2), CCW for second (i == 3)
-                // Loop until the edge sensor is on the black line after initially placing the robot centered on the black line
-                while (((lineTrackerValues = readLineTrackerValues()) & lineTrackerMask) == 0)
+                // Set hasLeftInitialBlackLine if all sensors are on white
+                if (lineTrackerValues == 0b00000)
                 {
-                    static constexpr uint8_t msTimerIncrements = 30;
-                    msSleep(msTimerIncrements);
-                    msTiming += msTimerIncrements;
+                    hasLeftInitialBlackLine = true;
                 }
-                forceStopMotors(msForceStopAfterRotateSlightlyDuration);
             }
-            // If calibrating section 1 timings for going in a hardcoded straight line
-            else if (i < 6)
+            uint16_t msTiming = lib::getMilliseconds() - msStart;
+            lib::forceStopMotors(lib::msForceStopAfterRotate90Duration);
+            return msTiming;
+        }
+        // If calibrating slight rotations
+        else if (test < 4)
+        {
+            uint8_t lineTrackerMask = (test == 2) ? 0b10000 : 0b00001; // CW for first test (test == 2), CCW for second (test == 3)
+            // Loop until the edge sensor is on the black line after initially placing the robot centered on the black line
+            while ((lib::readLineTrackerValues() & lineTrackerMask) == 0)
+            {
+            }
+            uint16_t msTiming = lib::getMilliseconds() - msStart;
+            lib::forceStopMotors(msForceStopAfterRotateSlightlyDuration);
+            return msTiming;
+        }
+        // If calibrating section 1 timings for going in a hardcoded straight line
+        else if (test < 6)
+        {
+            // Loop until the three middle sensors are on black for the section 1 start offset or until the center sensor is on
+            // black for the sensors to center of rotation
+            uint8_t mask = (test < 5) ? 0b01110 : 0b00100;
+            while ((lib::readLineTrackerValues() & mask) != mask)
             {
-                uint8_t mask;
-                // If calibrating section 1 start offset
-                if (i < 5)
+            }
+            uint16_t msTiming = lib::getMilliseconds() - msStart;
+            lib::forceStopMotors();
+            return msTiming;
+        }
+        // If calibrating distance between points in section 1 (3 inches)
+        else if (test < 7)
+        {
+            bool hasLeftInitialWhiteSection = false;
+            bool hasLeftInitialBlackLine = false;
+            // Loop until the three middle sensors are on black or while the line tracker has not at least left its initial position on the black line
+            while (((lineTrackerValues = lib::readLineTrackerValues()) & 0b01110) != 0b01110 || hasLeftInitialBlackLine == false)
+            {
+                // Set hasLeftInitialWhiteSection if the three middle sensors are on black
+                if ((lineTrackerValues & 0b01110) == 0b01110)
                 {
-                    mask = 0b01110;
+                    hasLeftInitialWhiteSection = true;
                 }
-                // If calibrating sensors to center of rotation
-                else
+                // Set hasLeftInitialBlackLine if both edge sensors are on white and the line tracker has left the white section
+                else if (hasLeftInitialWhiteSection && (lineTrackerValues & 0b10001) == 0)
                 {
-                    mask = 0b00100;
+                    hasLeftInitialBlackLine = true;
                 }
+            }
+            uint16_t msTiming = lib::getMilliseconds() - msStart;
+            lib::forceStopMotors();
+            return msTiming;
+        }
+
+        // If calibrating braking, after placing the robot a few inches behind a black line: reverse once the middle sensor has
+        // crossed the line and time how long the robot takes to come back to it. It stops about halfway through
+        while ((lib::readLineTrackerValues() & 0b00100) == 0)
+        {
+        }
+        while ((lib::readLineTrackerValues() & 0b00100) != 0)
+        {
+        }
+
+        int16_t dutyCycle = (test == 8) ? UINT8_MAX : lib::calibratedTimingSpeed;
+        lib::setMotorSpeed(-dutyCycle, -dutyCycle);
+        uint16_t msReverseStart = lib::getMilliseconds();
+        while ((lib::readLineTrackerValues() & 0b00100) == 0)
+        {
+        }
+        uint16_t msTiming = static_cast<uint16_t>(lib::getMilliseconds() - msReverseStart) / 2;
+
+        lib::setMotorSpeed(0, 0);
+        lib::msSleep(UINT8_MAX); // Let motors slow back down
+        return msTiming;
+    }
+
+    /// Combine the trials of a calibration test: the trials too far from their median are rejected as outliers, and the
+    /// median of the others is kept if a majority of the trials remain and they agree closely enough
+    /// \param msTrialTimings The timings of the trials, sorted in place
+    /// \param nbTrials       The number of trials
+    /// \param msTiming       The combined timing
+    /// \param msSpread       The difference between the longest and the shortest trials kept, saturated to 8 bits
+    /// \return Whether the timing is consistent enough to be used
+    bool getCalibratedTiming(uint16_t* msTrialTimings, uint8_t nbTrials, uint16_t& msTiming, uint8_t& msSpread)
+    {
+        // Insertion sort, as there are only a few trials
+        for (uint8_t i = 1; i < nbTrials; i++)
+        {
+            uint16_t msTrialTiming = msTrialTimings[i];
+            uint8_t j = i;
+            for (; j > 0 && msTrialTimings[j - 1] > msTrialTiming; j--)
+            {
+                msTrialTimings[j] = msTrialTimings[j - 1];
+            }
+            msTrialTimings[j] = msTrialTiming;
+        }
+        uint16_t msMedian = msTrialTimings[nbTrials / 2];
+
+        // Trials further than a quarter of the median from it are outliers, with some room for the very short timings
+        uint16_t msOutlierTolerance = (msMedian >> 2) + 10;
+        uint8_t firstKept = 0;
+        while (msMedian - msTrialTimings[firstKept] > msOutlierTolerance)
+        {
+            firstKept++;
+        }
+        uint8_t lastKept = nbTrials - 1;
+        while (msTrialTimings[lastKept] - msMedian > msOutlierTolerance)
+        {
+            lastKept--;
+        }
+
+        uint8_t nbKept = lastKept - firstKept + 1;
+        msTiming = msTrialTimings[(firstKept + lastKept) / 2];
+        uint16_t msKeptSpread = msTrialTimings[lastKept] - msTrialTimings[firstKept];
+        msSpread = (msKeptSpread > UINT8_MAX) ? UINT8_MAX : msKeptSpread;
+
+        // The trials kept must agree within an eighth of the timing, with the same room for the very short timings
+        return nbKept > nbTrials / 2 && msKeptSpread <= (msTiming >> 3) + 10;
+    }
+
+    /// Combine the trials of every calibration test and store the results in EEPROM in one go, only if all of them are
+    /// consistent so that a bad trial never reaches a run
+    /// \param msTrialTimings The timings of the trials of each test, sorted in place
+    /// \param nbTrials       The number of trials of each test
+    /// \return Whether the calibration was accepted and stored
+    bool storeCalibratedTimings(uint16_t (&msTrialTimings)[nbCalibrationTests][nbCalibrationTrials], uint8_t nbTrials)
+    {
+        uint16_t msTimings[nbCalibrationTests];
+        uint8_t msSpreads[nbCalibrationTests];
+        bool isAccepted = true;
+        for (uint8_t i = 0; i < nbCalibrationTests; i++)
+        {
+            bool isTimingAccepted = getCalibratedTiming(msTrialTimings[i], nbTrials, msTimings[i], msSpreads[i]);
+            DEBUG_PRINT("\t");
+            printCalibrationTestName(i);
+            DEBUG_PRINT(" timing: ");
+            DEBUG_PRINT_NUMBER(msTimings[i]);
+            DEBUG_PRINT(" (spread ");
+            DEBUG_PRINT_NUMBER(msSpreads[i]);
+            DEBUG_PRINT(isTimingAccepted ? ")\n" : "), rejected: the trials vary too much\n");
+            if (isTimingAccepted == false)
+            {
+                isAccepted = false;
+            }
+        }
+
+        if (isAccepted)
+        {
+            lib::ExternalMemory memoryInterface;
+            memoryInterface.write(0, reinterpret_cast<const uint8_t*>(msTimings), sizeof(msTimings));
+            memoryInterface.write(calibrationSpreadsAddress, msSpreads, sizeof(msSpreads));
+            DEBUG_PRINT("CALIBRATION COMPLETE\n");
+        }
+        else
+        {
+            DEBUG_PRINT("CALIBRATION REFUSED, KEEPING THE PREVIOUS TIMINGS\n");
+        }
+        lib::displayNumberOnTrackerLeds(0); // Turn off tracker LEDs while waiting for command (eventually, in main)
+
+        lib::msSleep(5); // Sleep for 5 ms to read back from EEPROM properly
+        return isAccepted;
+    }
+
+    /// Go forward until the line tracker is past the bar of the calibration sheet on which the robot stopped, and stop
+    /// there, so that the next test starts from a standstill as when the robot is placed by hand
+    void leaveCalibrationSheetBar()
+    {
+        lib::goStraight(lib::calibratedTimingSpeed);
+        while (lib::readLineTrackerValues() != 0)
+        {
+        }
+        lib::forceStopMotors();
+    }
+
+    /// Run every calibration test once, one after the other, on the calibration sheet (see lib::calibrateMotorTimingsInOnePass)
+    /// \param msTimings The timing of each test
+    void runCalibrationSheet(uint16_t (&msTimings)[nbCalibrationTests])
+    {
+        // Rotate to the next branch of the cross and back
+        msTimings[0] = runCalibrationTest(0);
+        msTimings[1] = runCalibrationTest(1);
+
+        // Rotate slightly clockwise, then counterclockwise from there, which rotates by twice the slight angle
+        msTimings[2] = runCalibrationTest(2);
+        msTimings[3] = runCalibrationTest(3) / 2;
+
+        // Center the robot back on the branch of the cross, which is too thin for the three middle sensors
+        lib::pulseMotorsClockwise();
+        lib::setMotorSpeed(lib::calibratedRotationSpeed, -lib::calibratedRotationSpeed);
+        while ((lib::readLineTrackerValues() & 0b00100) == 0)
+        {
+        }
+        lib::forceStopMotors(msForceStopAfterRotateSlightlyDuration);
+
+        // Drive across the bars, from the cross to the first one and then from each one to the next
+        msTimings[4] = runCalibrationTest(4);
+        leaveCalibrationSheetBar();
+        msTimings[5] = runCalibrationTest(5);
+        msTimings[6] = runCalibrationTest(6);
+        leaveCalibrationSheetBar();
+        msTimings[7] = runCalibrationTest(7);
+        leaveCalibrationSheetBar();
+        msTimings[8] = runCalibrationTest(8);
+    }
+
+    /// Get the duty cycle of a max power pulse in the direction of a duty cycle
+    /// \param dutyCycle The duty cycle giving the direction
+    /// \return The duty cycle of the pulse
+    constexpr int16_t getPulseDutyCycle(int16_t dutyCycle)
+    {
+        return (dutyCycle >= 0) ? UINT8_MAX : -UINT8_MAX;
+    }
+
+    /// Queue a pulse, a rotation at the calibrated rotation speed and a forced stop
+    /// \param isClockwise             The direction of the rotation
+    /// \param msRotationDuration      The duration of the rotation, after the pulse
+    /// \param msForceStopDuration     The duration of the forced stop, see forceStopMotors
+    /// \return Whether there was room for the motions
+    bool queueRotation(bool isClockwise, uint16_t msRotationDuration, uint8_t msForceStopDuration)
+    {
+        int16_t leftDutyCycle = isClockwise ? lib::calibratedRotationSpeed : -lib::calibratedRotationSpeed;
+        const Motion motions[] = {{MotionType::SetSpeed, getPulseDutyCycle(leftDutyCycle), getPulseDutyCycle(-leftDutyCycle), msMaxPulseDuration},
+                                  {MotionType::SetSpeed, leftDutyCycle, static_cast<int16_t>(-leftDutyCycle), msRotationDuration},
+                                  {MotionType::Reverse, 0, 0, msForceStopDuration},
+                                  {MotionType::SetSpeed, 0, 0, msForceStopDuration}};
+        if (queueMotions(motions, sizeof(motions) / sizeof(motions[0])) == false)
+        {
+            return false;
+        }
+        recordStop(2 * msForceStopDuration);
+        return true;
+    }
+} // namespace
+
+namespace lib
+{
+    // Global variable timings for 90 degree rotations (set by calibrateMotorRotationTimings)
+    uint16_t msRotate90ClockwiseDuration;
+    uint16_t msRotate90CounterclockwiseDuration;
+
+    // Global variable timings for section 1 blind movement
+    uint16_t msSection1StartOffsetDuration;
+    uint16_t msSensorToCenterOfRotationDuration;
+    uint16_t msBetweenPointsDuration;
+
+    void initializeMotors()
+    {        
+        setMotorPwmMode(defaultMotorPwmMode);
+
+        // Execute the queued motions, limit the slew rate and accumulate the odometry on every millisecond tick
+        setTickHandler(updateMotors);
+    }
+
+    void setMotorPwmMode(MotorPwmMode mode)
+    {
+        const MotorPwmSettings& settings = motorPwmSettings[static_cast<uint8_t>(mode)];
+
+        // Stop the timer while changing its mode, so that it does not run a period with half of the new settings
+        TCCR2B = 0;
+
+        // Timer counter control register flags (2x8 bits)
+        TCCR2A = settings.waveGenerationBits; // Set wave generation mode to phase-correct (WGM2 bits to 001) or fast (WGM2 bits to 011) 8-bit (0xFF TOP value) PWM
+        TCCR2A |= (1 << COM2A1); // Set compare output mode to clear OC2A on compare match (when up-counting in phase-correct mode) by setting COM2A bits to 10
+        TCCR2A |= (1 << COM2B1); // Set compare output mode to clear OC2B on compare match (when up-counting in phase-correct mode) by setting COM2B bits to 10
+        TCNT2 = 0;
+        TCCR2B = settings.clockSelectBits; // Set clock select to the divider of the mode with the CS2 bits
+
+        motorPwmMode = mode;
+    }
+
+    MotorPwmMode getMotorPwmMode()
+    {
+        return motorPwmMode;
+    }
+
+    bool calibrateMotorTimings()
+    {
+        DEBUG_PRINT("CALIBRATION STARTED\n");
+
+        // Calculate calibration values
+        uint16_t msTrialTimings[nbCalibrationTests][nbCalibrationTrials];
+        for (uint8_t i = 0; i < nbCalibrationTests; i++)
+        {
+            for (uint8_t trial = 0; trial < nbCalibrationTrials; trial++)
+            {
+                // Wait for button press
+                DEBUG_PRINT("\tAbout to calibrate ");
+                printCalibrationTestName(i);
+                DEBUG_PRINT(" timing (trial ");
+                DEBUG_PRINT_NUMBER(trial + 1);
+                DEBUG_PRINT('/');
+                DEBUG_PRINT_NUMBER(nbCalibrationTrials);
+                DEBUG_PRINT("), please place robot. Waiting for button press\n");
                 
-                // Loop until the three middle sensors are on black or until the center sensor is on black, depending on the mask
-                while (((lineTrackerValues = readLineTrackerValues()) & mask) != mask)
+                while (isButtonPressed() == false)
                 {
-                    static constexpr uint8_t msTimerIncrements = 30;
-                    msSleep(msTimerIncrements);
-                    msTiming += msTimerIncrements;
+                    readLineTrackerValues(); // Read line tracker values to help with placement
                 }
-                forceStopMotors();
+
+                msTrialTimings[i][trial] = runCalibrationTest(i);
             }
-            // If calibrating distance between points in section 1 (3 inches)
-            else
+        }
+
+        return storeCalibratedTimings(msTrialTimings, nbCalibrationTrials);
+    }
+
+    bool calibrateMotorTimingsInOnePass()
+    {
+        DEBUG_PRINT("CALIBRATION SHEET STARTED\n");
+
+        // Calculate calibration values, running the whole sheet for each trial
+        uint16_t msTrialTimings[nbCalibrationTests][nbCalibrationTrials];
+        for (uint8_t trial = 0; trial < nbCalibrationSheetTrials; trial++)
+        {
+            DEBUG_PRINT("\tAbout to run the calibration sheet (trial ");
+            DEBUG_PRINT_NUMBER(trial + 1);
+            DEBUG_PRINT('/');
+            DEBUG_PRINT_NUMBER(nbCalibrationSheetTrials);
+            DEBUG_PRINT("), please place robot on the cross. Waiting for button press\n");
+
+            while (isButtonPressed() == false)
             {
-                bool hasLeftInitialWhiteSection = false;
-                bool hasLeftInitialBlackLine = false;
-                // Loop until the three middle sensors are on black or while the line tracker has not at least left its initial position on the black line
-                while (((lineTrackerValues = readLineTrackerValues()) & 0b01110) != 0b01110 || hasLeftInitialBlackLine == false)
-                {
-                    // Set hasLeftInitialWhiteSection if the three middle sensors are on black
-                    if ((lineTrackerValues & 0b01110) == 0b01110)
-                    {
-                        hasLeftInitialWhiteSection = true;
-                    }
-                    // Set hasLeftInitialBlackLine if both edge sensors are on white and the line tracker has left the white section
-                    else if (hasLeftInitialWhiteSection && (lineTrackerValues & 0b10001) == 0)
-                    {
-                        hasLeftInitialBlackLine = true;
-                    }
-
-                    static constexpr uint8_t msTimerIncrements = 30;
-                    msSleep(msTimerIncrements);
-                    msTiming += msTimerIncrements;
-                }
-                forceStopMotors();
+                readLineTrackerValues(); // Read line tracker values to help with placement
             }
-            
-            // Store calibrated value in EEPROM
-            memoryInterface.write(i * 2, reinterpret_cast<const uint8_t*>(&msTiming), sizeof(msTiming));
-            DEBUG_PRINT("\tStoring ");
-            switch (i)
+
+            uint16_t msTimings[nbCalibrationTests];
+            runCalibrationSheet(msTimings);
+            for (uint8_t i = 0; i < nbCalibrationTests; i++)
             {
-            case 0:
-                DEBUG_PRINT("clockwise 90 degree rotation");
-                break;
-            case 1:
-                DEBUG_PRINT("counterclockwise 90 degree rotation");
-                break;
-            case 2:
-                DEBUG_PRINT("slight clockwise rotation");
-                break;
-            case 3:
-                DEBUG_PRINT("slight counterclockwise rotation");
-                break;
-            case 4:
-                DEBUG_PRINT("section 1 start offset");
-                break;
-            case 5:
-                DEBUG_PRINT("sensor to center of rottion");
-                break;
-            case 6:
-                DEBUG_PRINT("distance between points");
-                break;
+                msTrialTimings[i][trial] = msTimings[i];
             }
-            DEBUG_PRINT(" timing: ");
-            DEBUG_PRINT_NUMBER(msTiming);
-            DEBUG_PRINT('\n');
         }
 
-        DEBUG_PRINT("CALIBRATION COMPLETE\n");
-        displayNumberOnTrackerLeds(0); // Turn off tracker LEDs while waiting for command (eventually, in main)
-
-        msSleep(5); // Sleep for 5 ms to read back from EEPROM properly
+        return storeCalibratedTimings(msTrialTimings, nbCalibrationSheetTrials);
     }
 
     void readMotorTimings()
@@ -246,34 +924,16 @@ namespace lib
             uint16_t msTiming = 0;
             memoryInterface.read(i * 2, reinterpret_cast<uint8_t*>(&msTiming), sizeof(msTiming));
 
+            uint8_t msSpread = 0;
+            memoryInterface.read(calibrationSpreadsAddress + i, &msSpread);
+
             DEBUG_PRINT("\tReading ");
-            switch (i)
-            {
-            case 0:
-                DEBUG_PRINT("clockwise 90 degree rotation");
-                break;
-            case 1:
-                DEBUG_PRINT("counterclockwise 90 degree rotation");
-                break;
-            case 2:
-                DEBUG_PRINT("slight clockwise rotation");
-                break;
-            case 3:
-                DEBUG_PRINT("slight counterclockwise rotation");
-                break;
-            case 4:
-                DEBUG_PRINT("section 1 start offset");
-                break;
-            case 5:
-                DEBUG_PRINT("sensor to center of rotation");
-                break;
-            case 6:
-                DEBUG_PRINT("distance between points");
-                break;
-            }
+            printCalibrationTestName(i);
             DEBUG_PRINT(" timing: ");
             DEBUG_PRINT_NUMBER(msTiming);
-            DEBUG_PRINT('\n');
+            DEBUG_PRINT(" (spread ");
+            DEBUG_PRINT_NUMBER(msSpread);
+            DEBUG_PRINT(")\n");
 
             switch (i)
             {
@@ -298,170 +958,343 @@ namespace lib
             case 6: // Update timing for going between points (3 inches) in section 1
                 msBetweenPointsDuration = msTiming;
                 break;
+            case 7: // Update braking time from timing speed, keeping the fixed braking time if braking was never calibrated
+                msBrakeFromTimingSpeedDuration = (msTiming == 0 || msTiming > UINT8_MAX) ? UINT8_MAX : msTiming;
+                break;
+            case 8: // Update braking time from full speed
+                msBrakeFromFullSpeedDuration = (msTiming == 0 || msTiming > UINT8_MAX) ? UINT8_MAX : msTiming;
+                break;
             }
         }
 
         DEBUG_PRINT("READING CALIBRATION COMPLETE\n");
     }
     
-    void setMotorSpeed(int16_t leftDutyCycle, int16_t rightDutyCycle)
+    void calibrateMotorCurves()
     {
-        // Clamp left wheel duty cycle values between -255 and 255
-        if (leftDutyCycle < -UINT8_MAX)
-        {
-            leftDutyCycle = -UINT8_MAX;
-        }
-        else if (leftDutyCycle > UINT8_MAX)
-        {
-            leftDutyCycle = UINT8_MAX;
-        }
-        
-        // Clamp right wheel duty cycle values between -255 and 255
-        if (rightDutyCycle < -UINT8_MAX)
-        {
-            rightDutyCycle = -UINT8_MAX;
-        }
-        else if (rightDutyCycle > UINT8_MAX)
+        DEBUG_PRINT("MOTOR CURVES CALIBRATION STARTED\n");
+        DEBUG_PRINT("\tPlease place robot at the start of a long straight line. Waiting for button press\n");
+        while (isButtonPressed() == false)
         {
-            rightDutyCycle = UINT8_MAX;
+            readLineTrackerValues(); // Read line tracker values to help with placement
         }
 
-        // Reverse direction pin if duty cycle value is below 0 and invert if negative to set duty cycle to OCR2 registers
-        if (leftDutyCycle < 0)
-        {
-            PORTD |= static_cast<uint8_t>(Motor::LeftMotorDirection);
-            leftDutyCycle = -leftDutyCycle;
-        }
-        else
+        // Measure the motors as they are
+        leftMotorCurve = defaultLeftMotorCurve;
+        rightMotorCurve = defaultLeftMotorCurve;
+
+        // Go through the points of the curves from the slowest to the fastest while following the line, which leaves
+        // the stronger motor slowed down by the right amount at each of them
+        DutyCycleCurve leftCurve{};
+        DutyCycleCurve rightCurve{};
+        int16_t trim = 0;
+        bool isLineLost = false;
+        pulseMotorsForward();
+        for (uint8_t i = firstCalibratedCurvePoint; i < nbDutyCycleCurvePoints; i++)
         {
-            PORTD &= ~static_cast<uint8_t>(Motor::LeftMotorDirection);
+            uint8_t dutyCycle = (i == nbDutyCycleCurvePoints - 1) ? UINT8_MAX : (i << dutyCycleCurveShift);
+            int16_t meanTrim;
+            if (measureCurveTrim(dutyCycle, trim, meanTrim) == false)
+            {
+                isLineLost = true;
+                break;
+            }
+            leftCurve.dutyCycles[i] = dutyCycle - ((meanTrim > 0) ? meanTrim : 0);
+            rightCurve.dutyCycles[i] = dutyCycle - ((meanTrim < 0) ? -meanTrim : 0);
         }
-        
-        if (rightDutyCycle < 0)
+        forceStopMotors();
+
+        if (isLineLost)
         {
-            PORTD |= static_cast<uint8_t>(Motor::RightMotorDirection);
-            rightDutyCycle = -rightDutyCycle;
+            DEBUG_PRINT("\tLine lost, keeping the previous curves\n");
+            readMotorCurves();
+            return;
         }
-        else
+
+        // Below the first calibrated point, keep the ratio between the motors of that point
+        for (uint8_t i = 1; i < firstCalibratedCurvePoint; i++)
         {
-            PORTD &= ~static_cast<uint8_t>(Motor::RightMotorDirection);
+            leftCurve.dutyCycles[i] = leftCurve.dutyCycles[firstCalibratedCurvePoint] * i / firstCalibratedCurvePoint;
+            rightCurve.dutyCycles[i] = rightCurve.dutyCycles[firstCalibratedCurvePoint] * i / firstCalibratedCurvePoint;
         }
+        leftMotorCurve = leftCurve;
+        rightMotorCurve = rightCurve;
 
-        // Nerf right motor (because it is more powerful)
-        rightDutyCycle = rightDutyCycle * rightMotorNerfNumerator / rightMotorNerfDenominator;
-        
-        // Set duty cycles to OCR2 registers
-        // Important! OC2B is left, OC2A is right (see Config.h)
-        OCR2A = rightDutyCycle;
-        OCR2B = leftDutyCycle;        
+        // Store calibrated curves in EEPROM
+        ExternalMemory memoryInterface;
+        memoryInterface.write(leftMotorCurveAddress, leftCurve.dutyCycles, sizeof(leftCurve.dutyCycles));
+        msSleep(5); // Let the EEPROM finish its write cycle before the next one
+        memoryInterface.write(rightMotorCurveAddress, rightCurve.dutyCycles, sizeof(rightCurve.dutyCycles));
+
+        DEBUG_PRINT("MOTOR CURVES CALIBRATION COMPLETE\n");
+        msSleep(5); // Sleep for 5 ms to read back from EEPROM properly
     }
 
-    void goStraight(int16_t dutyCycle)
+    void readMotorCurves()
     {
-        // Motor max power pulse to kickstart them
-        if (dutyCycle >= 0)
+        DEBUG_PRINT("READING MOTOR CURVES STARTED\n");
+
+        ExternalMemory memoryInterface;
+        DutyCycleCurve leftCurve;
+        DutyCycleCurve rightCurve;
+        memoryInterface.read(leftMotorCurveAddress, leftCurve.dutyCycles, sizeof(leftCurve.dutyCycles));
+        memoryInterface.read(rightMotorCurveAddress, rightCurve.dutyCycles, sizeof(rightCurve.dutyCycles));
+
+        // An erased EEPROM reads as all ones, which is not a valid curve
+        if (isDutyCycleCurveValid(leftCurve) == false || isDutyCycleCurveValid(rightCurve) == false)
         {
-            pulseMotorsForward();
+            DEBUG_PRINT("\tMotor curves not calibrated, using the default curves\n");
+            leftCurve = defaultLeftMotorCurve;
+            rightCurve = defaultRightMotorCurve;
         }
-        else
+
+        cli(); // Clear global interrupt flag so that the tick ISR does not apply a half-copied curve
+        leftMotorCurve = leftCurve;
+        rightMotorCurve = rightCurve;
+        sei(); // Set global interrupt flag to enable interrupts
+
+        DEBUG_PRINT("\tMotor curves (left, right):");
+        for (uint8_t i = 0; i < nbDutyCycleCurvePoints; i++)
         {
-            pulseMotorsBackward();
+            DEBUG_PRINT(' ');
+            DEBUG_PRINT_NUMBER(leftCurve.dutyCycles[i]);
+            DEBUG_PRINT(',');
+            DEBUG_PRINT_NUMBER(rightCurve.dutyCycles[i]);
         }
+        DEBUG_PRINT('\n');
+
+        DEBUG_PRINT("READING MOTOR CURVES COMPLETE\n");
+    }
 
-        // Set motor speed 
-        setMotorSpeed(dutyCycle, dutyCycle);    
+    void setMotorSpeed(int16_t leftDutyCycle, int16_t rightDutyCycle)
+    {
+        // The program takes back control of the motors, after moving the pose with the previous duty cycles
+        abortMotion();
+        pollOdometry();
+        applyMotorSpeed(leftDutyCycle, rightDutyCycle);
+    }
+
+    void setCurvature(int16_t speed, int16_t curvature)
+    {
+        WheelDutyCycles dutyCycles = getCurvatureDutyCycles(speed, curvature);
+        setMotorSpeed(dutyCycles.left, dutyCycles.right);
+    }
+
+    void goStraight(int16_t dutyCycle)
+    {
+        // Motor max power pulse to kickstart them, followed by the duty cycle
+        abortMotion();
+        queueMotorPulse(dutyCycle, dutyCycle);
+        waitForMotion();
     }
 
     void pulseMotorsForward()
     {
-        setMotorSpeed(UINT8_MAX, UINT8_MAX);
-        msSleep(msMaxPulseDuration);
+        abortMotion();
+        queueMotorSpeed(UINT8_MAX, UINT8_MAX, msMaxPulseDuration);
+        waitForMotion();
     }
 
     void pulseMotorsBackward()
     {
-        setMotorSpeed(-UINT8_MAX, -UINT8_MAX);
-        msSleep(msMaxPulseDuration);
+        abortMotion();
+        queueMotorSpeed(-UINT8_MAX, -UINT8_MAX, msMaxPulseDuration);
+        waitForMotion();
     }
 
     void pulseMotorsClockwise()
     {
-        setMotorSpeed(UINT8_MAX, -UINT8_MAX);
-        msSleep(msMaxPulseDuration);
+        abortMotion();
+        queueMotorSpeed(UINT8_MAX, -UINT8_MAX, msMaxPulseDuration);
+        waitForMotion();
     }
 
     void pulseMotorsCounterclockwise()
     {
-        setMotorSpeed(-UINT8_MAX, UINT8_MAX);
-        msSleep(msMaxPulseDuration);
+        abortMotion();
+        queueMotorSpeed(-UINT8_MAX, UINT8_MAX, msMaxPulseDuration);
+        waitForMotion();
     }
 
     void rotate90Clockwise()
     {
-        pulseMotorsClockwise();
-        setMotorSpeed(calibratedRotationSpeed, -calibratedRotationSpeed);
-
-        msSleep(msRotate90ClockwiseDuration);
-        forceStopMotors(msForceStopAfterRotate90Duration);
+        abortMotion();
+        queueRotate90(true);
+        waitForMotion();
     }
 
     void rotate90Counterclockwise()
     {
-        pulseMotorsCounterclockwise();
-        setMotorSpeed(-calibratedRotationSpeed, calibratedRotationSpeed);
-
-        msSleep(msRotate90CounterclockwiseDuration);
-        forceStopMotors(msForceStopAfterRotate90Duration);
+        abortMotion();
+        queueRotate90(false);
+        waitForMotion();
     }
 
     void rotateSlightlyClockwise()
     {
-        pulseMotorsClockwise();
-        setMotorSpeed(calibratedRotationSpeed, -calibratedRotationSpeed);
-
-        msSleep(msRotateSlightlyClockwiseDuration);
-        forceStopMotors(msForceStopAfterRotateSlightlyDuration);
+        abortMotion();
+        queueRotateSlightly(true);
+        waitForMotion();
     }
 
     void rotateSlightlyCounterclockwise()
     {
-        pulseMotorsCounterclockwise();
-        setMotorSpeed(-calibratedRotationSpeed, calibratedRotationSpeed);
-
-        msSleep(msRotateSlightlyClockwiseDuration);
-        forceStopMotors(msForceStopAfterRotateSlightlyDuration);
+        abortMotion();
+        queueRotateSlightly(false);
+        waitForMotion();
     }
 
     void forceStopMotors(uint8_t msForcedDecelerationDuration)
     {
-        setMotorSpeed(-getLeftMotorSpeed(), -getRightMotorSpeed());
-        msSleep(msForcedDecelerationDuration);
-        setMotorSpeed(0, 0);
-        msSleep(msForcedDecelerationDuration); // Let motors slow back down
+        abortMotion();
+        queueForceStopMotors(msForcedDecelerationDuration);
+        waitForMotion();
     }
 
-    int16_t getLeftMotorSpeed()
+    void setMotorSlewRates(uint8_t maxAccelerationPerMs, uint8_t maxBrakingPerMs)
     {
-        if (PORTD & static_cast<uint8_t>(Motor::LeftMotorDirection)) // Read back direction bit from PORTD buffer
+        cli(); // Clear global interrupt flag so that the tick ISR sees both limits at once
+        maxAccelerationStep = maxAccelerationPerMs;
+        maxBrakingStep = maxBrakingPerMs;
+        sei(); // Set global interrupt flag to enable interrupts
+    }
+
+    bool queueMotorSpeed(int16_t leftDutyCycle, int16_t rightDutyCycle, uint16_t msDuration)
+    {
+        const Motion motion = {MotionType::SetSpeed, leftDutyCycle, rightDutyCycle, msDuration};
+        return queueMotions(&motion, 1);
+    }
+
+    bool queueMotorPulse(int16_t leftDutyCycle, int16_t rightDutyCycle)
+    {
+        const Motion motions[] = {{MotionType::SetSpeed, getPulseDutyCycle(leftDutyCycle), getPulseDutyCycle(rightDutyCycle), msMaxPulseDuration},
+                                  {MotionType::SetSpeed, leftDutyCycle, rightDutyCycle, 0}};
+        return queueMotions(motions, sizeof(motions) / sizeof(motions[0]));
+    }
+
+    bool queueForceStopMotors(uint8_t msForcedDecelerationDuration)
+    {
+        uint8_t msSettleDuration = msForcedDecelerationDuration;
+        if (msForcedDecelerationDuration == adaptiveBrakingDuration)
+        {
+            // Brake from the duty cycles of the last queued motion, or from the current ones if the queue is empty, which are
+            // the ones the stop will start from
+            cli(); // Clear global interrupt flag so that the queue does not move while it is read
+            int16_t leftDutyCycle = leftAppliedDutyCycle;
+            int16_t rightDutyCycle = rightAppliedDutyCycle;
+            if (nbQueuedMotions > 0)
+            {
+                uint8_t lastIndex = motionQueueHead + nbQueuedMotions - 1;
+                if (lastIndex >= motionQueueCapacity)
+                {
+                    lastIndex -= motionQueueCapacity;
+                }
+                const Motion& lastMotion = motionQueue[lastIndex];
+                leftDutyCycle = (lastMotion.type == MotionType::Reverse) ? 0 : lastMotion.leftDutyCycle;
+                rightDutyCycle = (lastMotion.type == MotionType::Reverse) ? 0 : lastMotion.rightDutyCycle;
+            }
+            sei(); // Set global interrupt flag to enable interrupts
+
+            msForcedDecelerationDuration = getBrakingDuration(leftDutyCycle, rightDutyCycle);
+            msSettleDuration = msForcedDecelerationDuration / 2;
+        }
+
+        const Motion motions[] = {{MotionType::Reverse, 0, 0, msForcedDecelerationDuration},
+                                  {MotionType::SetSpeed, 0, 0, msSettleDuration}};
+        if (queueMotions(motions, sizeof(motions) / sizeof(motions[0])) == false)
         {
-            return -static_cast<int16_t>(OCR2B);
+            return false;
         }
-        return OCR2B;
+        recordStop(msForcedDecelerationDuration + msSettleDuration);
+        return true;
     }
-    
-    int16_t getRightMotorSpeed()
+
+    bool queueRotate90(bool isClockwise)
+    {
+        return queueRotation(isClockwise, isClockwise ? msRotate90ClockwiseDuration : msRotate90CounterclockwiseDuration,
+                             msForceStopAfterRotate90Duration);
+    }
+
+    bool queueRotateSlightly(bool isClockwise)
+    {
+        return queueRotation(isClockwise, isClockwise ? msRotateSlightlyClockwiseDuration : msRotateSlightlyCounterclockwiseDuration,
+                             msForceStopAfterRotateSlightlyDuration);
+    }
+
+    bool isMotionComplete()
     {
-        if (PORTD & static_cast<uint8_t>(Motor::RightMotorDirection)) // Read back direction bit from PORTD buffer
+        cli(); // Clear global interrupt flag to read the queue state atomically
+        bool isComplete = nbQueuedMotions == 0 && msMotionRemaining == 0;
+        sei(); // Set global interrupt flag to enable interrupts
+        return isComplete;
+    }
+
+    void waitForMotion()
+    {
+        // Keep moving the pose, as the queued motions change the duty cycles from the tick ISR
+        while (isMotionComplete() == false)
         {
-            return -static_cast<int16_t>(OCR2A);
+            pollOdometry();
         }
-        return OCR2A;
+        pollOdometry();
+    }
+
+    void abortMotion()
+    {
+        cli(); // Clear global interrupt flag to disable interrupts
+        nbQueuedMotions = 0;
+        msMotionRemaining = 0;
+        sei(); // Set global interrupt flag to enable interrupts
+    }
+
+    int16_t getLeftMotorSpeed()
+    {
+        // Read back the duty cycle before the response curve, as OCR2B holds the corrected one, and restore the global
+        // interrupt flag instead of setting it, as the motion queue reads the duty cycles from the tick ISR
+        uint8_t sreg = SREG;
+        cli(); // Clear global interrupt flag to read the 16-bit duty cycle atomically
+        int16_t dutyCycle = leftAppliedDutyCycle;
+        SREG = sreg;
+        return dutyCycle;
+    }
+    
+    int16_t getRightMotorSpeed()
+    {
+        // Read back the duty cycle before the response curve, as OCR2A holds the corrected one, and restore the global
+        // interrupt flag instead of setting it, as the motion queue reads the duty cycles from the tick ISR
+        uint8_t sreg = SREG;
+        cli(); // Clear global interrupt flag to read the 16-bit duty cycle atomically
+        int16_t dutyCycle = rightAppliedDutyCycle;
+        SREG = sreg;
+        return dutyCycle;
     }
 
     int16_t getAverageMotorSpeed()
     {
         return (getLeftMotorSpeed() + getRightMotorSpeed()) / 2;
     }
+
+    uint16_t getStopDuration()
+    {
+        return msStopDuration;
+    }
+
+    uint16_t getNbStops()
+    {
+        return nbStops;
+    }
+
+    int32_t getDutyCycleIntegral()
+    {
+        cli(); // Clear global interrupt flag, as the motion queue changes the duty cycles from the tick ISR
+
+        // Include the duration since the last call to setMotorSpeed
+        uint16_t msSinceLastChange = getMilliseconds() - msLastMotorSpeedChange;
+        int32_t integral = dutyCycleIntegral + static_cast<int32_t>(averageDutyCycle) * msSinceLastChange;
+
+        sei(); // Set global interrupt flag to enable interrupts
+        return integral;
+    }
 } // namespace lib
         
     
\ No newline at end of file
@@ -22,26 +22,166 @@ namespace lib
     extern uint16_t msRotate90CounterclockwiseDuration;
     constexpr uint8_t msForceStopAfterRotate90Duration = 128;
 
-    /// Set TCNT2 settings for use as a PWM source for motors connected to OC2A and OC2B
+    /// Duration to give forceStopMotors to brake according to the calibrated braking model (set by calibrateMotorTimings)
+    constexpr uint8_t adaptiveBrakingDuration = 0;
+
+    /// PWM modes of the motors, from the lowest to the highest frequency (at 8 MHz). The motors are on OC2A and OC2B, so the
+    /// resolution stays at 8 bits: the outputs of the 16-bit Timer1 are on the direction pins, and Timer1 is the millisecond tick.
+    /// A higher frequency makes the motors pulse less at low duty cycles, but the H-bridge wastes more power switching
+    enum class MotorPwmMode : uint8_t
+    {
+        PhaseCorrect61Hz, // Phase-correct PWM, clock divided by 256
+        PhaseCorrect245Hz, // Phase-correct PWM, clock divided by 64
+        PhaseCorrect490Hz, // Phase-correct PWM, clock divided by 32
+        PhaseCorrect1960Hz, // Phase-correct PWM, clock divided by 8
+        Fast3900Hz, // Fast PWM, clock divided by 8
+        Fast31kHz, // Fast PWM, clock not divided
+        Count
+    };
+    constexpr uint8_t nbMotorPwmModes = static_cast<uint8_t>(MotorPwmMode::Count);
+
+    /// PWM mode set by initializeMotors, with which the calibrated timings were tuned
+    constexpr MotorPwmMode defaultMotorPwmMode = MotorPwmMode::PhaseCorrect61Hz;
+
+    /// Set TCNT2 settings for use as a PWM source for motors connected to OC2A and OC2B, in the default PWM mode
+    /// Note: requires startMillisecondClock() to have been called beforehand, as the motors are updated on every tick
     void initializeMotors();
 
-    /// Run semi-automated tests to calibrate the timings used for 90 degree rotations, slight rotations, and section 1 blind movement.
-    /// Places the values as the first 12 bytes of external EEPROM.
+    /// Change the PWM mode of the motors. The duty cycles are kept.
+    /// Note: in fast PWM modes, a zero duty cycle still gives a pulse of one timer clock per period, too short to move the motors
+    /// \param mode The PWM mode
+    void setMotorPwmMode(MotorPwmMode mode);
+
+    /// Get the PWM mode of the motors
+    /// \return The PWM mode
+    MotorPwmMode getMotorPwmMode();
+
+    /// Run semi-automated tests to calibrate the timings used for 90 degree rotations, slight rotations, section 1 blind movement and braking.
+    /// Each test is run several times, placing the robot again for each trial, and the median of the trials which agree with each other is kept.
+    /// Places the values as the first 18 bytes of external EEPROM and the spreads of the trials after them (see Config.h), but only if
+    /// the trials of every test are consistent, so that a bad calibration never replaces a good one.
     /// Note: needs to be placed perfectly straight with its middle line tracker sensor on the outside edge of a black line for each of the first 4 tests.
     ///       For the 5th and 6th tests, needs to be placed perpendicular to black lines separated by 8 and 5 inches respectively.
     ///       For the 7th test, needs to be placed behind a black line, after which there is 3 inches before the edge of another black line.
+    ///       For the 8th and 9th tests, needs to be placed perpendicular to a black line, a few inches behind it, with room to drive past it
+    /// Note: in debug mode, requires initializeUsart() to have been called beforehand
+    /// \return Whether the calibration was accepted and stored
+    bool calibrateMotorTimings();
+
+    /// Calibrate the same timings as calibrateMotorTimings on a calibration sheet, running every test one after the other
+    /// without placing the robot again. The sheet is run several times, placing the robot at its start for each trial, and
+    /// the results are combined and stored as with calibrateMotorTimings.
+    /// Note: the calibration sheet has, in order along the direction of travel:
+    ///       - A cross of thin black lines, with the robot placed on it like for the first test of calibrateMotorTimings, with its
+    ///         middle line tracker sensor on the outside edge of the branch pointing in the direction of travel.
+    ///         The robot rotates to the next branch and back, then slightly clockwise and counterclockwise, and centers itself on the branch.
+    ///         The branch must end before the first bar and be thinner than the spacing of the sensors.
+    ///       - Bar 1, 8 inches ahead of the line tracker.
+    ///       - Bar 2, 5 inches past bar 1.
+    ///       - Bar 3, 3 inches past bar 2.
+    ///       - Bar 4, a few inches past bar 3.
+    ///       - Bar 5, a few inches past bar 4, with room to drive past it at full speed.
+    ///       All the distances are from the far edge of the previous bar, and all the bars are perpendicular to the direction of travel
     /// Note: in debug mode, requires initializeUsart() to have been called beforehand
-    void calibrateMotorTimings();
+    /// \return Whether the calibration was accepted and stored
+    bool calibrateMotorTimingsInOnePass();
 
     /// Read the motor timings back from external EEPROM
     void readMotorTimings();
 
-    /// Set PWM duty cycle for each motor to adjust their speed.
-    /// It also hardcodes a nerf for the right motor, which, experimentally, has shown to be stronger than the left one
+    /// Run a semi-automated test to calibrate the response curve of each motor, so that the robot goes straight when both
+    /// motors are given the same duty cycle, at every speed. Places the curves in external EEPROM, see Config.h.
+    /// Note: needs to be placed straight at the start of a long straight black line (about a meter), with the line under its middle sensor.
+    ///       If the line is lost, the previous curves are kept
+    /// Note: in debug mode, requires initializeUsart() to have been called beforehand
+    void calibrateMotorCurves();
+
+    /// Read the response curves of the motors back from external EEPROM. If they were never calibrated, the right motor,
+    /// which experimentally has shown to be stronger than the left one, is slowed down by a constant factor instead
+    void readMotorCurves();
+
+    /// Set PWM duty cycle for each motor to adjust their speed. Cancels the queued motions, see abortMotion.
+    /// The duty cycles are corrected by the response curve of each motor, see calibrateMotorCurves
     /// \param leftDutyCycle  Duty cycle with which to set OCR2A (clamped between -255 and 255), negative values mean the wheel will go in reverse
     /// \param rightDutyCycle Duty cycle with which to set OCR2B (clamped between -255 and 255), negative values mean the wheel will go in reverse
     void setMotorSpeed(int16_t leftDutyCycle, int16_t rightDutyCycle);
 
+    /// Distance between the middles of the two wheels, for turns specified by their curvature
+    constexpr uint8_t wheelbaseMm = 130;
+
+    /// Curvatures are the inverse of the radius of the turn of the center of the robot, in 2^-16 per millimeter,
+    /// positive when turning clockwise
+    constexpr uint8_t curvatureShift = 16;
+
+    /// Duty cycles of both motors
+    struct WheelDutyCycles
+    {
+        int16_t left;
+        int16_t right;
+    };
+
+    /// Smallest radius whose curvature fits in 16 bits, tighter turns being clamped to it
+    constexpr uint8_t minCurvatureRadiusMm = 3;
+
+    /// Get the curvature of a turn of a given radius
+    /// \param radiusMm The radius of the turn of the center of the robot in millimeters, positive when turning clockwise.
+    ///                 Radii under minCurvatureRadiusMm give the tightest curvature, +/-INT16_MAX, which is clockwise for 0
+    /// \return The curvature, rounded to the nearest unit
+    constexpr int16_t getCurvature(int16_t radiusMm)
+    {
+        return (radiusMm < 0) ? -getCurvature((radiusMm < -INT16_MAX) ? INT16_MAX : -radiusMm)
+             : (radiusMm < minCurvatureRadiusMm) ? INT16_MAX
+             : ((1L << curvatureShift) + radiusMm / 2) / radiusMm;
+    }
+
+    /// Get the duty cycles which make the robot follow an arc. The wheels go at speeds proportional to their distance from the
+    /// center of the turn, the calibrated response curves of the motors making them turn at the same speed for the same duty cycle.
+    /// When the outer wheel would go over full speed, both are slowed down in the same proportion to keep the curvature
+    /// \param speed     The duty cycle of the center of the robot (between -255 and 255)
+    /// \param curvature The curvature of the arc, see getCurvature
+    /// \return The duty cycles of the motors
+    constexpr WheelDutyCycles getCurvatureDutyCycles(int16_t speed, int16_t curvature)
+    {
+        // Half of the difference between the wheels, rounded to the nearest duty cycle
+        int16_t difference = (static_cast<int32_t>(speed) * curvature * (wheelbaseMm / 2) + (1L << (curvatureShift - 1))) >> curvatureShift;
+        int16_t left = speed + difference;
+        int16_t right = speed - difference;
+
+        int16_t absoluteLeft = (left < 0) ? -left : left;
+        int16_t absoluteRight = (right < 0) ? -right : right;
+        int16_t maxDutyCycle = (absoluteLeft > absoluteRight) ? absoluteLeft : absoluteRight;
+        if (maxDutyCycle > UINT8_MAX)
+        {
+            left = static_cast<int32_t>(left) * UINT8_MAX / maxDutyCycle;
+            right = static_cast<int32_t>(right) * UINT8_MAX / maxDutyCycle;
+        }
+        return {left, right};
+    }
+
+    /// Make the robot follow an arc, see getCurvatureDutyCycles. Cancels the queued motions, see abortMotion
+    /// \param speed     The duty cycle of the center of the robot (between -255 and 255)
+    /// \param curvature The curvature of the arc, see getCurvature
+    void setCurvature(int16_t speed, int16_t curvature);
+
+    /// Make the robot follow an arc known at compile time, whose duty cycles are computed by the compiler
+    /// \tparam Speed     The duty cycle of the center of the robot (between -255 and 255)
+    /// \tparam Curvature The curvature of the arc, see getCurvature
+    template <int16_t Speed, int16_t Curvature>
+    void setCurvature()
+    {
+        constexpr WheelDutyCycles dutyCycles = getCurvatureDutyCycles(Speed, Curvature);
+        setMotorSpeed(dutyCycles.left, dutyCycles.right);
+    }
+
+    /// Limit how fast the duty cycles change. The duty cycles set by setMotorSpeed are then reached over the next milliseconds
+    /// instead of right away, which reduces wheel slip. Moving a duty cycle towards zero brakes and moving it away from zero
+    /// accelerates, and reversing a motor brakes down to zero before accelerating in the other direction.
+    /// The limits are off by default, as the calibrated timings and the pulses were tuned without them.
+    /// Note: requires startMillisecondClock() to have been called beforehand
+    /// \param maxAccelerationPerMs Maximum increase of the absolute duty cycles per millisecond, or 0 for no limit
+    /// \param maxBrakingPerMs      Maximum decrease of the absolute duty cycles per millisecond, or 0 for no limit
+    void setMotorSlewRates(uint8_t maxAccelerationPerMs, uint8_t maxBrakingPerMs);
+
     /// Make the robot go straight by giving its wheels the same speed. This differs from setMotorSpeed as it gives
     /// the motors a short max power pulse to kickstart them, in the hopes of getting a straighter line
     /// \param dutyCycle Duty cycle with which to set the motors (clamped between -255 and 255), negative values mean the wheels will go in reverse
@@ -75,21 +215,85 @@ namespace lib
     /// Rotate by a small angle counterclockwise. Useful for realigning
     void rotateSlightlyCounterclockwise();
 
-    /// Set PWM duty cycle to the opposite of current speed for a small amount of time to decelerate motors faster and then turn them off
-    /// \param msForcedDecelerationDuration  8-bit time in milliseconds for which to decelerate forcefully. Default value is 255 ms
-    void forceStopMotors(uint8_t msForcedDecelerationDuration = 255);
+    /// Set PWM duty cycle to the opposite of current speed for a small amount of time to decelerate motors faster and then turn them off.
+    /// The motors are then left off for the same amount of time, or for half of the braking time with adaptive braking
+    /// \param msForcedDecelerationDuration  8-bit time in milliseconds for which to decelerate forcefully, or adaptiveBrakingDuration
+    ///                                     to brake for the time the calibrated model gives for the current speed, which is
+    ///                                     shorter at low speeds. Default value is adaptiveBrakingDuration
+    void forceStopMotors(uint8_t msForcedDecelerationDuration = adaptiveBrakingDuration);
+
+    /// Get the total time spent in forced stops, both blocking and queued, to measure the time lost stopping in a section
+    /// Note: wraps around every 65.5 seconds, so only differences between two readings should be used
+    /// \return The total time in milliseconds
+    uint16_t getStopDuration();
+
+    /// Get the number of forced stops, both blocking and queued
+    /// \return The number of forced stops
+    uint16_t getNbStops();
+
+    // Asynchronous motions: the functions below queue motions which the millisecond tick ISR executes one after the other,
+    // so that the program can keep reading the sensors instead of sleeping. Each returns false without queueing anything
+    // if the queue does not have room for all of its motions. Calling setMotorSpeed or any blocking motor function cancels
+    // the motions still in the queue, as the blocking motor functions above queue their own motions and wait for them.
+    // Note: require startMillisecondClock() and initializeMotors() to have been called beforehand
+
+    /// Queue a change of the duty cycles, held for a duration before the next motion starts
+    /// \param leftDutyCycle  Duty cycle of the left motor (clamped between -255 and 255)
+    /// \param rightDutyCycle Duty cycle of the right motor (clamped between -255 and 255)
+    /// \param msDuration     Duration in milliseconds before the next motion starts. Default value is 0
+    /// \return Whether the motion was queued
+    bool queueMotorSpeed(int16_t leftDutyCycle, int16_t rightDutyCycle, uint16_t msDuration = 0);
 
-    /// Get left motor PWM duty cycle
+    /// Queue a short max power pulse to kickstart the motors in the direction of the given duty cycles, followed by these duty cycles
+    /// \param leftDutyCycle  Duty cycle of the left motor after the pulse (clamped between -255 and 255)
+    /// \param rightDutyCycle Duty cycle of the right motor after the pulse (clamped between -255 and 255)
+    /// \return Whether the motions were queued
+    bool queueMotorPulse(int16_t leftDutyCycle, int16_t rightDutyCycle);
+
+    /// Queue a forced stop, see forceStopMotors. The duty cycles are reversed as they are when the stop starts
+    /// \param msForcedDecelerationDuration  8-bit time in milliseconds for which to decelerate forcefully, or adaptiveBrakingDuration
+    ///                                     to brake according to the duty cycles of the last queued motion, or to the current
+    ///                                     ones if the queue is empty. Default value is adaptiveBrakingDuration
+    /// \return Whether the motions were queued
+    bool queueForceStopMotors(uint8_t msForcedDecelerationDuration = adaptiveBrakingDuration);
+
+    /// Queue a 90 degree rotation in place, see rotate90Clockwise and rotate90Counterclockwise
+    /// \param isClockwise The direction of the rotation
+    /// \return Whether the motions were queued
+    bool queueRotate90(bool isClockwise);
+
+    /// Queue a rotation by a small angle, see rotateSlightlyClockwise and rotateSlightlyCounterclockwise
+    /// \param isClockwise The direction of the rotation
+    /// \return Whether the motions were queued
+    bool queueRotateSlightly(bool isClockwise);
+
+    /// Get whether all the queued motions are done
+    /// \return Whether the queue is empty and the last motion held its duty cycles for its whole duration
+    bool isMotionComplete();
+
+    /// Block until all the queued motions are done
+    void waitForMotion();
+
+    /// Cancel the queued motions, leaving the motors at their current duty cycles. Useful to stop a rotation early
+    void abortMotion();
+
+    /// Get left motor PWM duty cycle, as given to setMotorSpeed before the response curve of the motor is applied
     /// \return Duty cycle (clamped between -255 and 255), negative values mean the wheel is going in reverse
     int16_t getLeftMotorSpeed();
 
-    /// Get right motor PWM duty cycle
+    /// Get right motor PWM duty cycle, as given to setMotorSpeed before the response curve of the motor is applied
     /// \return Duty cycle (clamped between -255 and 255), negative values mean the wheel is going in reverse
     int16_t getRightMotorSpeed();
 
     /// Get the average of both motor PWM duty cycles
     /// \return The average speed of both motors
     int16_t getAverageMotorSpeed();
+
+    /// Get the integral over time of the average duty cycle set with setMotorSpeed since the robot started, which is
+    /// an uncalibrated measure of the distance travelled forward (reversing decreases it and rotating in place does not change it)
+    /// Note: requires startMillisecondClock() to have been called beforehand
+    /// \return The integral of the average duty cycle, in duty cycle milliseconds
+    int32_t getDutyCycleIntegral();
 } // namespace lib
 
 #endif // MOTORS_H
\ No newline at end of file
@@ -0,0 +1,246 @@
+/// Dead reckoning of the pose of the robot from the duty cycles of the motors and the calibrated motion model
+/// \file Odometry.cpp
+/// \author Misha Krieger-Raynauld (1952515), Simon Gauvin (1951457), Vlad Drelciuc (1941366), Nicolas Charron (1960356)
+/// \date 2019-04-08
+
+#include "Odometry.h"
+#include <avr/interrupt.h>
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+#include "MotionModel.h"
+
+namespace
+{
+    // The speeds are tabulated for every sixteenth of the duty cycle, so that the tick ISR interpolates them with shifts
+    // instead of divisions. The last point is for a duty cycle of 256
+    constexpr uint8_t speedTableShift = 4;
+    constexpr uint8_t nbSpeedTablePoints = (256 >> speedTableShift) + 1;
+
+    // Headings are in 2^-32 turns, so that they wrap around with the integer, and their 16 MSBs are a binary angle
+    constexpr uint32_t headingPerDegree = 11930465; // 2^32 / 360
+    constexpr uint16_t quarterTurn = 1 << 14;
+
+    // Sines are in 2^-14 units
+    constexpr uint8_t sineShift = 14;
+    constexpr uint8_t nbSineQuarterTurnSteps = 64;
+
+    /// Sine over a quarter turn, with both ends included
+    struct SineTable
+    {
+        int16_t values[nbSineQuarterTurnSteps + 1];
+    };
+
+    /// Generate the sine table from its Taylor series, precise enough over a quarter turn
+    /// \return The generated table
+    constexpr SineTable makeSineTable()
+    {
+        SineTable table{};
+        for (uint8_t i = 0; i <= nbSineQuarterTurnSteps; i++)
+        {
+            double angle = 1.5707963267948966 * i / nbSineQuarterTurnSteps;
+            double term = angle;
+            double sine = 0;
+            for (uint8_t n = 1; n <= 11; n += 2)
+            {
+                sine += term;
+                term = -term * angle * angle / ((n + 1) * (n + 2));
+            }
+            table.values[i] = static_cast<int16_t>(sine * (1 << sineShift) + 0.5);
+        }
+        return table;
+    }
+
+    // Table stored in flash, as it is only read
+    constexpr SineTable sineTable PROGMEM = makeSineTable();
+
+    /// Read a value of the sine table from flash
+    /// \param index The index of the value, between 0 and nbSineQuarterTurnSteps
+    /// \return The sine, in 2^-14 units
+    int16_t readSineTable(uint8_t index)
+    {
+        return static_cast<int16_t>(pgm_read_word(&sineTable.values[index]));
+    }
+
+    /// Get the sine of a binary angle, to the nearest 64th of a quarter turn
+    /// \param angle The angle, in 2^-16 turns
+    /// \return The sine, in 2^-14 units
+    int16_t getSine(uint16_t angle)
+    {
+        uint8_t index = (angle >> 8) & (nbSineQuarterTurnSteps - 1);
+        switch (angle >> 14)
+        {
+        case 0:
+            return readSineTable(index);
+        case 1:
+            return readSineTable(nbSineQuarterTurnSteps - index);
+        case 2:
+            return -readSineTable(index);
+        default:
+            return -readSineTable(nbSineQuarterTurnSteps - index);
+        }
+    }
+
+    // Speed of a wheel (in millimeters per millisecond, see motionModelRateShift) and rotation speed of the robot rotating
+    // in place (in headings per millisecond) at every point of the tables
+    uint16_t wheelSpeeds[nbSpeedTablePoints];
+    int32_t turnRates[nbSpeedTablePoints];
+
+    // Heading and distance travelled since the last poll, accumulated by the tick ISR with additions only
+    volatile uint32_t heading = 0;
+    volatile int32_t distanceTravelled = 0;
+
+    // Position in millimeters shifted by motionModelRateShift, integrated from the distance travelled when polled,
+    // and heading at the last poll
+    int32_t xPosition = 0;
+    int32_t yPosition = 0;
+    uint32_t polledHeading = 0;
+
+    // Forward speed and rotation speed for the current duty cycles
+    volatile int16_t forwardSpeed = 0;
+    volatile int32_t turnRate = 0;
+
+    /// Multiply a value by a sine without overflowing 32 bits, by splitting the value around the sine shift
+    /// \param value The value
+    /// \param sine  The sine, in 2^-14 units
+    /// \return The product, in the units of the value
+    int32_t multiplyBySine(int32_t value, int16_t sine)
+    {
+        int32_t integerPart = value >> sineShift;
+        int32_t fractionalPart = value & ((1L << sineShift) - 1);
+        return integerPart * sine + ((fractionalPart * sine) >> sineShift);
+    }
+
+    /// Get a value of a speed table at a duty cycle, linearly interpolated between its points
+    /// \tparam T        The type of the values of the table
+    /// \param table     The table
+    /// \param dutyCycle The duty cycle, between -255 and 255. Negative values give the opposite of the value
+    /// \return The value
+    template <typename T>
+    int32_t interpolateSpeed(const T (&table)[nbSpeedTablePoints], int16_t dutyCycle)
+    {
+        uint8_t absoluteDutyCycle = (dutyCycle < 0) ? -dutyCycle : dutyCycle;
+        int32_t speed;
+        if (absoluteDutyCycle == UINT8_MAX)
+        {
+            speed = table[nbSpeedTablePoints - 1];
+        }
+        else
+        {
+            uint8_t index = absoluteDutyCycle >> speedTableShift;
+            uint8_t fraction = absoluteDutyCycle & ((1 << speedTableShift) - 1);
+            int32_t speedDifference = static_cast<int32_t>(table[index + 1]) - table[index];
+            speed = table[index] + ((speedDifference * fraction) >> speedTableShift);
+        }
+        return (dutyCycle < 0) ? -speed : speed;
+    }
+
+    /// Get a coordinate in millimeters shifted by motionModelRateShift, rounded to the nearest multiple of the grid spacing
+    /// \param position      The coordinate
+    /// \param gridSpacingMm The spacing of the grid, in millimeters
+    /// \return The coordinate of the nearest node
+    int32_t roundToGrid(int32_t position, uint8_t gridSpacingMm)
+    {
+        int32_t gridSpacing = static_cast<int32_t>(gridSpacingMm) << lib::motionModelRateShift;
+        int32_t nodeIndex = (position + ((position < 0) ? -gridSpacing : gridSpacing) / 2) / gridSpacing;
+        return nodeIndex * gridSpacing;
+    }
+} // namespace
+
+namespace lib
+{
+    void initializeOdometry()
+    {
+        for (uint8_t i = 1; i < nbSpeedTablePoints; i++)
+        {
+            uint8_t dutyCycle = (i == nbSpeedTablePoints - 1) ? UINT8_MAX : (i << speedTableShift);
+            wheelSpeeds[i] = getTranslationRate(dutyCycle);
+            turnRates[i] = static_cast<uint32_t>(getRotationRate(dutyCycle)) * (headingPerDegree >> motionModelRateShift);
+        }
+        wheelSpeeds[0] = 0;
+        turnRates[0] = 0;
+
+        resetOdometry();
+    }
+
+    void resetOdometry(int16_t xMm, int16_t yMm, uint16_t headingAngle)
+    {
+        xPosition = static_cast<int32_t>(xMm) << motionModelRateShift;
+        yPosition = static_cast<int32_t>(yMm) << motionModelRateShift;
+
+        cli(); // Clear global interrupt flag so that the tick ISR does not accumulate into a half-written pose
+        heading = headingAngle * headingPerDegree;
+        distanceTravelled = 0;
+        polledHeading = heading;
+        sei(); // Set global interrupt flag to enable interrupts
+    }
+
+    void pollOdometry()
+    {
+        cli(); // Clear global interrupt flag to take the accumulated motion atomically
+        uint32_t currentHeading = heading;
+        int32_t distance = distanceTravelled;
+        distanceTravelled = 0;
+        sei(); // Set global interrupt flag to enable interrupts
+
+        // Move along the mean heading since the last poll, which is the direction of the chord of an arc
+        uint16_t angle = (polledHeading + static_cast<int32_t>(currentHeading - polledHeading) / 2) >> 16;
+        polledHeading = currentHeading;
+        xPosition += multiplyBySine(distance, getSine(angle));
+        yPosition += multiplyBySine(distance, getSine(angle + quarterTurn));
+    }
+
+    int16_t getOdometryX()
+    {
+        pollOdometry();
+        return xPosition >> motionModelRateShift;
+    }
+
+    int16_t getOdometryY()
+    {
+        pollOdometry();
+        return yPosition >> motionModelRateShift;
+    }
+
+    uint16_t getOdometryHeading()
+    {
+        cli(); // Clear global interrupt flag to read the 32-bit heading atomically
+        uint32_t currentHeading = heading;
+        sei(); // Set global interrupt flag to enable interrupts
+        return (currentHeading >> 16) * 360UL >> 16;
+    }
+
+    void snapOdometryToGridNode(uint8_t gridSpacingMm, uint8_t sensorDistanceMm)
+    {
+        pollOdometry();
+
+        // Snap the position of the line tracker, which is on the node, and move the center of rotation back behind it
+        uint16_t angle = polledHeading >> 16;
+        int32_t xOffset = (static_cast<int32_t>(sensorDistanceMm) * getSine(angle)) << (motionModelRateShift - sineShift);
+        int32_t yOffset = (static_cast<int32_t>(sensorDistanceMm) * getSine(angle + quarterTurn)) << (motionModelRateShift - sineShift);
+        xPosition = roundToGrid(xPosition + xOffset, gridSpacingMm) - xOffset;
+        yPosition = roundToGrid(yPosition + yOffset, gridSpacingMm) - yOffset;
+    }
+
+    void snapOdometryHeading()
+    {
+        pollOdometry();
+
+        cli(); // Clear global interrupt flag so that the tick ISR does not turn the robot while it is snapped
+        heading = (heading + (1UL << 29)) & 0xC0000000;
+        polledHeading = heading;
+        sei(); // Set global interrupt flag to enable interrupts
+    }
+
+    void setOdometryDutyCycles(int16_t leftDutyCycle, int16_t rightDutyCycle)
+    {
+        // Both wheels move the robot forward, and turn it clockwise when the left one is faster
+        forwardSpeed = (interpolateSpeed(wheelSpeeds, leftDutyCycle) + interpolateSpeed(wheelSpeeds, rightDutyCycle)) / 2;
+        turnRate = (interpolateSpeed(turnRates, leftDutyCycle) - interpolateSpeed(turnRates, rightDutyCycle)) / 2;
+    }
+
+    void updateOdometry()
+    {
+        heading += turnRate;
+        distanceTravelled += forwardSpeed;
+    }
+} // namespace lib
@@ -0,0 +1,71 @@
+/// Dead reckoning of the pose of the robot from the duty cycles of the motors and the calibrated motion model
+/// \file Odometry.h
+/// \author Misha Krieger-Raynauld (1952515), Simon Gauvin (1951457), Vlad Drelciuc (1941366), Nicolas Charron (1960356)
+/// \date 2019-04-08
+
+#ifndef ODOMETRY_H
+#define ODOMETRY_H
+
+#include <stdint.h>
+
+namespace lib
+{
+    // The pose is integrated on every millisecond tick from the duty cycles applied to the motors: each wheel moves at the
+    // speed the motion model gives for its duty cycle, and turns the robot by half of the rotation speed the motion model
+    // gives for its duty cycle when rotating in place. The position is the center of rotation of the robot, in millimeters,
+    // with the y axis pointing forward and the x axis pointing right when the heading is 0. The heading grows clockwise.
+    // As there is no wheel encoder, the pose drifts, so it should be snapped back whenever the sensors give a known position.
+    // To keep the tick short, it only accumulates the heading and the distance travelled, which pollOdometry() turns into a
+    // position along the mean heading since the last poll.
+    // Note: require startMillisecondClock() and initializeMotors() to have been called beforehand
+
+    /// Build the speed tables of the odometry from the motion model and reset the pose
+    /// Note: requires readMotionModel() to have been called beforehand
+    void initializeOdometry();
+
+    /// Set the pose of the robot
+    /// \param xMm          The x coordinate of the center of rotation, in millimeters
+    /// \param yMm          The y coordinate of the center of rotation, in millimeters
+    /// \param headingAngle The heading, in degrees clockwise from the y axis
+    void resetOdometry(int16_t xMm = 0, int16_t yMm = 0, uint16_t headingAngle = 0);
+
+    /// Move the position by the distance travelled since the last poll, along the mean heading since then. This is only
+    /// exact when the curvature stays the same, so the heading must stay roughly constant, or change at a constant rate,
+    /// between two polls: a rotation in place followed by a straight move would otherwise be counted as a diagonal.
+    /// The motors poll whenever the program changes their duty cycles and while waiting for queued motions, and so do the
+    /// getters and the snaps, so it only needs to be called by loops which wait for queued motions or for the slew rate limiter
+    /// without waitForMotion
+    void pollOdometry();
+
+    /// Get the x coordinate of the center of rotation of the robot
+    /// \return The x coordinate, in millimeters
+    int16_t getOdometryX();
+
+    /// Get the y coordinate of the center of rotation of the robot
+    /// \return The y coordinate, in millimeters
+    int16_t getOdometryY();
+
+    /// Get the heading of the robot
+    /// \return The heading, in degrees clockwise from the y axis (between 0 and 359)
+    uint16_t getOdometryHeading();
+
+    /// Snap the position to the nearest node of a square grid whose origin is a node, when the line tracker detects a node
+    /// (a point, or a crossing of lines). The heading is kept
+    /// \param gridSpacingMm    The distance between two nodes of the grid, in millimeters
+    /// \param sensorDistanceMm The distance of the line tracker ahead of the center of rotation, or 0 if the center of
+    ///                         rotation is on the node
+    void snapOdometryToGridNode(uint8_t gridSpacingMm, uint8_t sensorDistanceMm);
+
+    /// Snap the heading to the nearest quarter turn, when the robot is known to be aligned with a line of the grid
+    void snapOdometryHeading();
+
+    /// Set the duty cycles with which the pose is integrated, called by the motors whenever their duty cycles change
+    /// \param leftDutyCycle  Duty cycle of the left motor, between -255 and 255
+    /// \param rightDutyCycle Duty cycle of the right motor, between -255 and 255
+    void setOdometryDutyCycles(int16_t leftDutyCycle, int16_t rightDutyCycle);
+
+    /// Accumulate the heading and the distance travelled over one millisecond, called by the motors on every tick
+    void updateOdometry();
+} // namespace lib
+
+#endif // ODOMETRY_H
@@ -0,0 +1,108 @@
+/// Fixed-size window of the most recent samples keeping running statistics up to date
+/// \file SlidingWindow.h
+/// \author Misha Krieger-Raynauld (1952515), Simon Gauvin (1951457), Vlad Drelciuc (1941366), Nicolas Charron (1960356)
+/// \date 2019-04-02
+
+#ifndef SLIDINGWINDOW_H
+#define SLIDINGWINDOW_H
+
+#include <stdint.h>
+
+namespace lib
+{
+    /// Container holding the last N samples added to it along with their running sum and sum of squares.
+    /// Adding a sample evicts the oldest one once the window is full, and both statistics are updated
+    /// incrementally so that reading them never requires iterating over the samples
+    /// \tparam T       The type of the samples
+    /// \tparam N       The number of samples kept in the window (max 255)
+    /// \tparam SumType The type used for the accumulators. Must be able to hold N times the square of the largest sample
+    template <typename T, uint8_t N, typename SumType = int32_t>
+    class SlidingWindow
+    {
+        static_assert(N > 0, "SlidingWindow must hold at least one sample");
+
+    public:
+        /// Default constructor
+        SlidingWindow()
+            : m_samples{}
+            , m_nextIndex(0)
+            , m_size(0)
+            , m_sum(0)
+            , m_sumOfSquares(0)
+        {
+        }
+
+        /// Add a sample to the window, evicting the oldest one if the window is full
+        /// \param sample The sample to add
+        void add(T sample)
+        {
+            // Remove the contribution of the sample about to be overwritten
+            if (m_size == N)
+            {
+                T oldestSample = m_samples[m_nextIndex];
+                m_sum -= oldestSample;
+                m_sumOfSquares -= static_cast<SumType>(oldestSample) * oldestSample;
+            }
+            else
+            {
+                m_size++;
+            }
+
+            m_samples[m_nextIndex] = sample;
+            m_sum += sample;
+            m_sumOfSquares += static_cast<SumType>(sample) * sample;
+
+            // Wrap around without a modulo, which is costly on 8-bit microcontrollers
+            if (++m_nextIndex == N)
+            {
+                m_nextIndex = 0;
+            }
+        }
+
+        /// Remove all samples from the window and reset the statistics
+        void clear()
+        {
+            m_nextIndex = 0;
+            m_size = 0;
+            m_sum = 0;
+            m_sumOfSquares = 0;
+        }
+
+        /// Retrieve the sum of the samples currently in the window
+        /// \return The sum of the samples
+        SumType sum() const { return m_sum; }
+
+        /// Retrieve the sum of the squares of the samples currently in the window
+        /// \return The sum of the squares of the samples
+        SumType sumOfSquares() const { return m_sumOfSquares; }
+
+        /// Retrieve the most recently added sample. Calling newest on an empty window is undefined
+        /// \return The most recently added sample
+        T newest() const { return m_samples[m_nextIndex == 0 ? N - 1 : m_nextIndex - 1]; }
+
+        /// Retrieve the number of samples currently in the window
+        /// \return The number of samples
+        uint8_t size() const { return m_size; }
+
+        /// Return true if the window holds N samples
+        /// \return true if the window is full
+        bool full() const { return m_size == N; }
+
+        /// Return true if the window holds no samples
+        /// \return true if the window is empty
+        bool empty() const { return m_size == 0; }
+
+        /// Retrieve the number of samples the window can hold
+        /// \return The capacity of the window
+        static constexpr uint8_t capacity() { return N; }
+
+    private:
+        T m_samples[N];
+        uint8_t m_nextIndex;
+        uint8_t m_size;
+        SumType m_sum;
+        SumType m_sumOfSquares;
+    };
+} // namespace lib
+
+#endif // SLIDINGWINDOW_H
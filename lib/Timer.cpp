@@ -14,6 +14,19 @@ namespace
 {
     constexpr uint16_t msDelayLoop2Multiplier =  F_CPU / 1000 / 4; // Coefficient (2000) for generating a 1 ms delay with _delay_loop_2
     constexpr uint16_t usDelayLoop2Multiplier =  F_CPU / 1000 / 1000 / 4; // Coefficient (2) for generating a 1 us delay with _delay_loop_2
+
+    constexpr uint8_t tickPrescaler = 64;
+    constexpr uint16_t ocr1aTickCompareValue = F_CPU / tickPrescaler / 1000 - 1; // Value (124) for OCR1A to generate a 1 ms tick
+
+    // Millisecond clock and remaining duration of the timer, updated by the tick ISR
+    volatile uint16_t msClock;
+    volatile uint16_t msTimerRemaining;
+
+    // Whether the tick runs at all times, see startMillisecondClock
+    volatile bool isClockRunning = false;
+
+    // Function called by the tick ISR, see setTickHandler
+    volatile lib::TickHandler tickHandler = nullptr;
 } // namespace
 
 namespace lib
@@ -27,10 +40,23 @@ namespace lib
 
         // Timer counter control register flags (3x8 bits)
         TCCR1A = 0; // Not used in this particular case
-        TCCR1B |= (1 << CS12) | (1 << CS10); // Set clock select to clock divided by 1024 by setting CS1 bits to 101
+        TCCR1B |= (1 << CS11) | (1 << CS10); // Set clock select to clock divided by 64 by setting CS1 bits to 011
         TCCR1B |= (1 << WGM12); // Set CTC mode with OCR1A as TOP source by setting WGM1 bits to 0100 (two LSBs on TCCR1A and two MSBs on TCCR1B)
         TCCR1C = 0; // Not used in this particular case
 
+        // Interrupt every millisecond once the interrupt is enabled, by startTimer or startMillisecondClock
+        TCNT1 = 0;
+        OCR1A = ocr1aTickCompareValue;
+
+        sei(); // Set global interrupt flag to enable interrupts
+    }
+
+    void startMillisecondClock()
+    {
+        cli(); // Clear global interrupt flag to disable interrupts
+
+        isClockRunning = true;
+
         // Enable interrupt when TCNT1 = OCR1A
         TIMSK1 |= (1 << OCIE1A);
 
@@ -39,19 +65,44 @@ namespace lib
         
     void startTimer(uint16_t duration)
     {
+        // Convert the duration from units of 1024 clock cycles to milliseconds, rounding up (no overflow: 67107840 < 4294967295)
+        static constexpr uint16_t clockCyclesPerMs = F_CPU / 1000;
+        uint16_t msDuration = (static_cast<uint32_t>(duration) * 1024 + clockCyclesPerMs - 1) / clockCyclesPerMs;
+
         cli(); // Clear global interrupt flag to disable interrupts
         
-        isTimerExpired = false;
+        // Set the remaining duration, which is decremented by the tick ISR
+        msTimerRemaining = msDuration;
+        isTimerExpired = (msDuration == 0);
 
-        // Reset counter
-        TCNT1 = 0;
-        
-        // Set output compare register to the desired duration
-        OCR1A = duration;
+        // Start the tick for the duration of the timer if it does not run at all times, from a whole millisecond
+        if (isClockRunning == false && isTimerExpired == false)
+        {
+            TCNT1 = 0;
+            TIFR1 = (1 << OCF1A); // Clear a compare match left pending by the previous timer
+            TIMSK1 |= (1 << OCIE1A);
+        }
         
         sei(); // Set global interrupt flag to enable interrupts
     }
 
+    uint16_t getMilliseconds()
+    {
+        // Restore the global interrupt flag instead of setting it, as the clock is also read from ISRs
+        uint8_t sreg = SREG;
+        cli(); // Clear global interrupt flag to read the 16-bit clock atomically
+        uint16_t milliseconds = msClock;
+        SREG = sreg;
+        return milliseconds;
+    }
+
+    void setTickHandler(TickHandler handler)
+    {
+        cli(); // Clear global interrupt flag to write the 16-bit pointer atomically
+        tickHandler = handler;
+        sei(); // Set global interrupt flag to enable interrupts
+    }
+
     void usSleep(uint16_t duration)
     {
         // No overflow : 131070 < 4294967295
@@ -75,6 +126,20 @@ namespace lib
 
     void msSleep(uint16_t duration)
     {
+        // Count whole milliseconds on the clock if it runs and can advance, starting from the next tick
+        if (isClockRunning && (SREG & (1 << SREG_I)))
+        {
+            uint16_t msStart = getMilliseconds();
+            while (getMilliseconds() == msStart)
+            {
+            }
+            msStart++;
+            while (static_cast<uint16_t>(getMilliseconds() - msStart) < duration)
+            {
+            }
+            return;
+        }
+
         // No overflow : 131070000 < 4294967295
         uint32_t delayLoop2Ticks = static_cast<uint32_t>(duration) * msDelayLoop2Multiplier;
 
@@ -95,8 +160,30 @@ namespace lib
     }
 } // namespace lib
 
-/// Interrupt service routine for TCNT1 match with OCR1A
+/// Interrupt service routine for TCNT1 match with OCR1A, called every millisecond
 ISR(TIMER1_COMPA_vect)
 {
-    lib::isTimerExpired = true;
+    msClock++;
+
+    // Count down the timer and expire it when it reaches zero
+    if (msTimerRemaining > 0)
+    {
+        msTimerRemaining--;
+        if (msTimerRemaining == 0)
+        {
+            lib::isTimerExpired = true;
+
+            // Stop the tick until the next timer if it is only needed by the timer
+            if (isClockRunning == false)
+            {
+                TIMSK1 &= ~(1 << OCIE1A);
+            }
+        }
+    }
+
+    lib::TickHandler handler = tickHandler;
+    if (handler != nullptr)
+    {
+        handler();
+    }
 }
\ No newline at end of file
@@ -12,20 +12,40 @@ namespace lib
 {
     /// Global variable for the timer
     extern volatile bool isTimerExpired;
+
+    /// Function called on every millisecond tick
+    using TickHandler = void (*)();
     
-    /// Set TCNT0 settings for use as a timer with interrupts on OCR0A
+    /// Set TCNT1 settings for use as a 1 ms tick with interrupts on OCR1A. The tick only runs while the timer counts down,
+    /// unless startMillisecondClock() is called, so that it does not add jitter to the timing of programs which do not need it
     void initializeTimer();
+
+    /// Keep the tick running at all times, which drives the millisecond clock and the tick handler
+    /// Note: requires initializeTimer() to have been called beforehand
+    void startMillisecondClock();
     
     /// Reset and set timer with a given duration of up to 8.3 seconds
     /// \param duration Duration of the timer in clock cycles multiplied by prescaler (1024).
-    ///                 Note: max value is 65535 (about 8.3 seconds)
+    ///                 Note: max value is 65535 (about 8.3 seconds). The duration is rounded up to the millisecond
     void startTimer(uint16_t duration);
 
+    /// Get the number of milliseconds elapsed since startMillisecondClock() was called
+    /// Note: wraps around every 65.5 seconds, so only differences between two readings should be used
+    /// \return The current time in milliseconds
+    uint16_t getMilliseconds();
+
+    /// Set a function to call on every millisecond tick, from the tick ISR with interrupts disabled.
+    /// It must be short, as the tick of the next millisecond waits for it to return and it delays the main program
+    /// Note: requires startMillisecondClock() to have been called beforehand
+    /// \param handler The function to call, or nullptr to call none
+    void setTickHandler(TickHandler handler);
+
     /// Sleep for a number of microseconds
     /// \param duration The duration for which to sleep, in milliseconds    
     void usSleep(uint16_t duration);
 
-    /// Sleep for a number of milliseconds
+    /// Sleep for a number of milliseconds. While the millisecond clock runs, the sleep is timed with it, so that the time
+    /// spent in interrupts does not make the sleep longer
     /// \param duration The duration for which to sleep, in milliseconds
     void msSleep(uint16_t duration);
 } // namespace lib
@@ -0,0 +1,372 @@
+/// Map of a section recorded on a first run and replayed on the following runs to anticipate curves
+/// \file CourseMap.cpp
+/// \author Misha Krieger-Raynauld (1952515), Simon Gauvin (1951457), Vlad Drelciuc (1941366), Nicolas Charron (1960356)
+/// \date 2019-04-03
+
+#include "CourseMap.h"
+#include "Debug.h"
+#include "ExternalMemory.h"
+#include "Motors.h"
+
+namespace
+{
+    // Location of the maps in external EEPROM (see Config.h), each map being a magic byte,
+    // the number of segments, and then the segments
+    constexpr uint16_t courseMapsAddress = 256;
+    constexpr uint8_t courseMapSize = 128;
+    constexpr uint8_t nbCourseMaps = 4;
+    constexpr uint8_t courseMapMagic = 0xC3; // Anything but the value of erased memory (0xFF)
+
+    // Curvature of the parts of the section where the robot was not tracking with the map
+    constexpr int8_t unmappedCurvature = INT8_MIN;
+
+    // Curvature from which a segment is considered a curve rather than a straight line
+    constexpr int8_t minCurveCurvature = 10;
+
+    // Number of consecutive samples with a different curvature before starting a new segment when recording
+    constexpr uint8_t nbSamplesToConfirmCurvature = 6;
+
+    // Number of consecutive samples not matching the map before considering that the course diverged when replaying
+    constexpr uint8_t maxNbMismatchingSamples = 15;
+
+    // Distances, in units of 256 duty cycle milliseconds (at a duty cycle of 150, 100 units take about 170 ms)
+    constexpr uint16_t brakingDistance = 150; // Distance before a curve at which to start braking
+    constexpr uint16_t boundaryTolerance = 80; // Distance around segment boundaries within which mismatches are ignored
+    constexpr uint16_t junctionTolerance = 120; // Maximum distance between a junction and where it was recorded
+
+    /// Get the address of the map of a section in external EEPROM
+    /// \param sectionNumber The number of the section, indexed from 1
+    /// \return The address of the map
+    uint16_t getCourseMapAddress(uint8_t sectionNumber)
+    {
+        return courseMapsAddress + (sectionNumber - 1) * courseMapSize;
+    }
+
+    /// Check if a curvature corresponds to a straight line
+    /// \param curvature The curvature to check
+    /// \return Whether the curvature is a mapped straight line
+    bool isStraight(int8_t curvature)
+    {
+        return curvature != unmappedCurvature && curvature < minCurveCurvature && curvature > -minCurveCurvature;
+    }
+
+    /// Get the direction of a curvature
+    /// \param curvature The curvature
+    /// \return -1 for a left curve, 1 for a right curve, 0 for a straight line
+    int8_t getCurvatureDirection(int8_t curvature)
+    {
+        if (isStraight(curvature))
+        {
+            return 0;
+        }
+        return (curvature < 0) ? -1 : 1;
+    }
+
+    /// Check if the line tracker values indicate a junction (T, branch, or perpendicular line). The three middle sensors must
+    /// be on black, as an edge sensor alone also sees the line in tight curves
+    /// \param lineTrackerValues The line tracker readings
+    /// \return Whether the robot is on a junction
+    bool isOnJunction(uint8_t lineTrackerValues)
+    {
+        return (lineTrackerValues & 0b01110) == 0b01110;
+    }
+
+    /// Erase the map of a section in external EEPROM by clearing its magic byte, so that it is recorded again on the next run
+    /// \param sectionNumber The number of the section, indexed from 1
+    void eraseCourseMap(uint8_t sectionNumber)
+    {
+        lib::ExternalMemory memoryInterface;
+        memoryInterface.write(getCourseMapAddress(sectionNumber), 0);
+    }
+} // namespace
+
+CourseMap::CourseMap(uint8_t sectionNumber)
+    : m_sectionNumber(sectionNumber)
+    , m_mode(Mode::Recording)
+    , m_segments{}
+    , m_nbSegments(0)
+    , m_currentSegment(0)
+    , m_startDutyCycleIntegral(lib::getDutyCycleIntegral())
+    , m_positionOffset(0)
+    , m_lastPosition(0)
+    , m_isTracking(false)
+    , m_wasOnJunction(false)
+    , m_nbConflictingSamples(0)
+    , m_segmentCurvatureSum(0)
+    , m_nbSegmentSamples(0)
+    , m_differentialWindow()
+{
+    lib::ExternalMemory memoryInterface;
+    uint16_t address = getCourseMapAddress(sectionNumber);
+
+    // Load the map if one was stored for the section
+    uint8_t header[2];
+    memoryInterface.read(address, header, sizeof(header));
+    if (header[0] == courseMapMagic && header[1] > 0 && header[1] <= maxNbSegments)
+    {
+        m_nbSegments = header[1];
+        memoryInterface.read(address + sizeof(header), reinterpret_cast<uint8_t*>(m_segments), m_nbSegments * sizeof(Segment));
+        m_mode = Mode::Replaying;
+        DEBUG_PRINT("\tReplaying course map with ");
+        DEBUG_PRINT_NUMBER(m_nbSegments);
+        DEBUG_PRINT(" segments\n");
+    }
+    else
+    {
+        DEBUG_PRINT("\tRecording course map\n");
+    }
+}
+
+void CourseMap::startTracking()
+{
+    m_isTracking = false;
+    m_nbConflictingSamples = 0;
+    m_differentialWindow.clear();
+}
+
+void CourseMap::update(uint8_t lineTrackerValues, int16_t wheelDifferential)
+{
+    if (m_mode == Mode::Diverged)
+    {
+        return;
+    }
+
+    uint16_t position = getPosition();
+
+    // Average the wheel differential, as the tracking algorithms constantly correct from one side to the other
+    m_differentialWindow.add(wheelDifferential);
+    int16_t curvature = m_differentialWindow.sum() / m_differentialWindow.size() / 2;
+    if (curvature > INT8_MAX)
+    {
+        curvature = INT8_MAX;
+    }
+    else if (curvature < -INT8_MAX)
+    {
+        curvature = -INT8_MAX;
+    }
+
+    // Only keep the moment the robot reaches a junction
+    bool isOnJunctionNow = isOnJunction(lineTrackerValues);
+    bool hasReachedJunction = isOnJunctionNow && m_wasOnJunction == false;
+    m_wasOnJunction = isOnJunctionNow;
+
+    if (m_mode == Mode::Recording)
+    {
+        record(position, curvature, hasReachedJunction);
+    }
+    else
+    {
+        replay(position, curvature, hasReachedJunction);
+    }
+
+    m_isTracking = true;
+    m_lastPosition = position;
+}
+
+CourseHint CourseMap::getHint() const
+{
+    if (m_mode != Mode::Replaying)
+    {
+        return CourseHint::None;
+    }
+
+    // Brake if a curve or an unmapped part of the section is coming
+    if (m_currentSegment + 1 < m_nbSegments)
+    {
+        const Segment& nextSegment = m_segments[m_currentSegment + 1];
+        if (isStraight(nextSegment.curvature) == false &&
+            static_cast<int32_t>(nextSegment.position) - m_lastPosition <= brakingDistance)
+        {
+            return CourseHint::CurveAhead;
+        }
+    }
+
+    if (isStraight(m_segments[m_currentSegment].curvature))
+    {
+        return CourseHint::Straight;
+    }
+    return CourseHint::None;
+}
+
+void CourseMap::save()
+{
+    if (m_mode != Mode::Recording || m_nbSegments == 0)
+    {
+        return;
+    }
+
+    // Mark the end of the last tracked part of the section
+    startSegment(m_lastPosition, unmappedCurvature, false);
+
+    lib::ExternalMemory memoryInterface;
+    uint16_t address = getCourseMapAddress(m_sectionNumber);
+
+    // Total size is at most 122 bytes, which is below the 127 bytes write limit
+    const uint8_t header[2] = {courseMapMagic, m_nbSegments};
+    memoryInterface.write(address, header, sizeof(header));
+    memoryInterface.write(address + sizeof(header), reinterpret_cast<const uint8_t*>(m_segments), m_nbSegments * sizeof(Segment));
+
+    DEBUG_PRINT("\tStored course map with ");
+    DEBUG_PRINT_NUMBER(m_nbSegments);
+    DEBUG_PRINT(" segments\n");
+}
+
+void CourseMap::eraseAll()
+{
+    for (uint8_t i = 1; i <= nbCourseMaps; i++)
+    {
+        eraseCourseMap(i);
+    }
+}
+
+uint16_t CourseMap::getPosition() const
+{
+    // Divide by 256 to fit a whole section in 16 bits
+    int32_t position = ((lib::getDutyCycleIntegral() - m_startDutyCycleIntegral) >> 8) + m_positionOffset;
+    if (position < 0)
+    {
+        return 0;
+    }
+    else if (position > UINT16_MAX)
+    {
+        return UINT16_MAX;
+    }
+    return position;
+}
+
+void CourseMap::record(uint16_t position, int8_t curvature, bool hasReachedJunction)
+{
+    if (m_isTracking == false)
+    {
+        // Mark the part of the section where the robot did something else as unmapped if it moved in the meantime
+        if (m_nbSegments > 0 && position > m_lastPosition + boundaryTolerance)
+        {
+            startSegment(m_lastPosition, unmappedCurvature, false);
+        }
+
+        // Start a new segment unless the robot continues the previous one
+        if (m_nbSegments == 0 || m_segments[m_currentSegment].curvature == unmappedCurvature)
+        {
+            startSegment(position, curvature, hasReachedJunction);
+            return;
+        }
+    }
+
+    if (hasReachedJunction)
+    {
+        startSegment(position, curvature, true);
+        return;
+    }
+
+    // Start a new segment once the curvature has been different for long enough
+    if (getCurvatureDirection(curvature) != getCurvatureDirection(m_segments[m_currentSegment].curvature))
+    {
+        m_nbConflictingSamples++;
+        if (m_nbConflictingSamples >= nbSamplesToConfirmCurvature)
+        {
+            startSegment(position, curvature, false);
+            return;
+        }
+    }
+    else
+    {
+        m_nbConflictingSamples = 0;
+    }
+
+    m_segmentCurvatureSum += curvature;
+    m_nbSegmentSamples++;
+}
+
+void CourseMap::replay(uint16_t position, int8_t curvature, bool hasReachedJunction)
+{
+    // Advance to the segment containing the position
+    while (m_currentSegment + 1 < m_nbSegments && m_segments[m_currentSegment + 1].position <= position)
+    {
+        m_currentSegment++;
+    }
+
+    // Resynchronize the position on the junctions, as they are the most reliable landmarks
+    if (hasReachedJunction)
+    {
+        bool isJunctionInMap = false;
+        uint8_t firstSegment = (m_currentSegment > 0) ? m_currentSegment - 1 : 0;
+        for (uint8_t i = firstSegment; i < m_nbSegments && i <= m_currentSegment + 2; i++)
+        {
+            int16_t distance = m_segments[i].position - position;
+            if (m_segments[i].startsWithJunction && distance <= static_cast<int16_t>(junctionTolerance) &&
+                distance >= -static_cast<int16_t>(junctionTolerance))
+            {
+                m_positionOffset += distance;
+                m_currentSegment = i;
+                isJunctionInMap = true;
+                break;
+            }
+        }
+
+        if (isJunctionInMap == false)
+        {
+            DEBUG_PRINT("\tCourse map diverged: unexpected junction\n");
+            diverge();
+            return;
+        }
+    }
+
+    // Check that the curvature matches the map, except close to the segment boundaries where the robot may be early or late
+    const Segment& segment = m_segments[m_currentSegment];
+    if (m_differentialWindow.full() && segment.curvature != unmappedCurvature &&
+        getCurvatureDirection(curvature) != getCurvatureDirection(segment.curvature) &&
+        static_cast<int32_t>(position) - segment.position > boundaryTolerance &&
+        static_cast<int32_t>(getSegmentEnd(m_currentSegment)) - position > boundaryTolerance)
+    {
+        m_nbConflictingSamples++;
+        if (m_nbConflictingSamples > maxNbMismatchingSamples)
+        {
+            DEBUG_PRINT("\tCourse map diverged: unexpected curvature\n");
+            diverge();
+        }
+    }
+    else
+    {
+        m_nbConflictingSamples = 0;
+    }
+}
+
+void CourseMap::diverge()
+{
+    m_mode = Mode::Diverged;
+
+    // The map is known to be wrong, so it is erased right away rather than replayed again on the next runs
+    eraseCourseMap(m_sectionNumber);
+}
+
+void CourseMap::startSegment(uint16_t position, int8_t curvature, bool startsWithJunction)
+{
+    // Store the average curvature of the segment being closed
+    if (m_nbSegments > 0 && m_segments[m_currentSegment].curvature != unmappedCurvature && m_nbSegmentSamples > 0)
+    {
+        m_segments[m_currentSegment].curvature = m_segmentCurvatureSum / m_nbSegmentSamples;
+    }
+    m_segmentCurvatureSum = 0;
+    m_nbSegmentSamples = 0;
+    m_nbConflictingSamples = 0;
+
+    // Keep the last slot to mark the end of the section. If the map is full, the last segment is extended
+    uint8_t maxNbSegmentsOfType = (curvature == unmappedCurvature) ? maxNbSegments : maxNbSegments - 1;
+    if (m_nbSegments >= maxNbSegmentsOfType)
+    {
+        return;
+    }
+
+    m_segments[m_nbSegments] = {position, curvature, startsWithJunction};
+    m_currentSegment = m_nbSegments;
+    m_nbSegments++;
+}
+
+uint16_t CourseMap::getSegmentEnd(uint8_t segmentIndex) const
+{
+    if (segmentIndex + 1 < m_nbSegments)
+    {
+        return m_segments[segmentIndex + 1].position;
+    }
+    return UINT16_MAX;
+}
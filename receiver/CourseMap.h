@@ -0,0 +1,120 @@
+/// Map of a section recorded on a first run and replayed on the following runs to anticipate curves
+/// \file CourseMap.h
+/// \author Misha Krieger-Raynauld (1952515), Simon Gauvin (1951457), Vlad Drelciuc (1941366), Nicolas Charron (1960356)
+/// \date 2019-04-03
+
+#ifndef COURSEMAP_H
+#define COURSEMAP_H
+
+#include <stdint.h>
+#include "SlidingWindow.h"
+
+/// What the course map knows about the course just ahead of the robot
+enum class CourseHint : uint8_t
+{
+    None, // Nothing known, the speed must be adjusted reactively
+    Straight, // The robot is on a known straight line which does not end soon
+    CurveAhead // A curve, or a part of the section not followed with the map, is coming
+};
+
+/// Segment map of a section. The first traversal of a section records its segments (where the robot went straight, where it
+/// curved, where it crossed junctions) into external EEPROM, and later traversals load them back to give hints about what is
+/// coming. Positions are measured with the duty cycle integral of the motors, so they do not depend on the speed of the robot.
+/// If the course observed while replaying does not match the map, the map stops giving hints for the rest of the section
+/// and is erased, so that the next run records it again
+class CourseMap
+{
+public:
+    enum class Mode : uint8_t
+    {
+        Recording, // No map was stored for the section, the segments are being recorded
+        Replaying, // A map was loaded and the course matches it so far
+        Diverged // A map was loaded but the course did not match it, so it was erased
+    };
+
+    /// Constructor. Loads the map of the section from external EEPROM, or starts recording if there is none
+    /// \param sectionNumber The number of the section, indexed from 1
+    explicit CourseMap(uint8_t sectionNumber);
+
+    /// Signal that a tracking algorithm starts using the map, after the robot did something else since the last update
+    /// (the part of the section in between is marked as unmapped)
+    void startTracking();
+
+    /// Update the map with the latest tracking data. To be called once per tracking loop
+    /// \param lineTrackerValues    The latest line tracker readings
+    /// \param wheelDifferential    The difference between the left and the right motor duty cycles
+    void update(uint8_t lineTrackerValues, int16_t wheelDifferential);
+
+    /// Get what is known about the course just ahead of the robot
+    /// \return The hint for the speed of the robot
+    CourseHint getHint() const;
+
+    /// Store the recorded map in external EEPROM if the map was recording. To be called at the end of the section
+    void save();
+
+    /// Get the mode of the map
+    /// \return The mode of the map
+    Mode getMode() const { return m_mode; }
+
+    /// Erase every stored map so that they are recorded again on the next run. Useful after recalibrating the motors
+    static void eraseAll();
+
+private:
+    /// Part of the section with a constant curvature, or starting at a junction
+    struct Segment
+    {
+        uint16_t position; // Start of the segment
+        int8_t curvature; // Average wheel differential divided by 2, or unmappedCurvature
+        bool startsWithJunction;
+    };
+
+    static constexpr uint8_t maxNbSegments = 30;
+    static constexpr uint8_t nbDifferentialSamples = 8;
+
+    /// Get the position of the robot since the start of the section
+    /// \return The position, in units of 256 duty cycle milliseconds
+    uint16_t getPosition() const;
+
+    /// Record the latest tracking data, starting a new segment when the curvature changes or at junctions
+    /// \param position            The position of the robot
+    /// \param curvature           The current curvature
+    /// \param hasReachedJunction  Whether the robot just reached a junction
+    void record(uint16_t position, int8_t curvature, bool hasReachedJunction);
+
+    /// Follow the position of the robot in the map and check that the course matches it
+    /// \param position            The position of the robot
+    /// \param curvature           The current curvature
+    /// \param hasReachedJunction  Whether the robot just reached a junction
+    void replay(uint16_t position, int8_t curvature, bool hasReachedJunction);
+
+    /// Stop following the map for the rest of the section and erase it from external EEPROM
+    void diverge();
+
+    /// Start a new recorded segment, closing the current one
+    /// \param position            The start of the segment
+    /// \param curvature           The curvature of the segment, or unmappedCurvature
+    /// \param startsWithJunction  Whether the segment starts at a junction
+    void startSegment(uint16_t position, int8_t curvature, bool startsWithJunction);
+
+    /// Get the end of a segment, which is the start of the next one
+    /// \param segmentIndex The index of the segment
+    /// \return The end of the segment, or UINT16_MAX for the last segment
+    uint16_t getSegmentEnd(uint8_t segmentIndex) const;
+
+    uint8_t m_sectionNumber;
+    Mode m_mode;
+    Segment m_segments[maxNbSegments];
+    uint8_t m_nbSegments;
+    uint8_t m_currentSegment;
+    int32_t m_startDutyCycleIntegral;
+    int16_t m_positionOffset;
+    uint16_t m_lastPosition;
+    bool m_isTracking;
+    bool m_wasOnJunction;
+    uint8_t m_nbConflictingSamples;
+    int32_t m_segmentCurvatureSum;
+    uint16_t m_nbSegmentSamples;
+    lib::SlidingWindow<int16_t, nbDifferentialSamples> m_differentialWindow;
+};
+
+#endif // COURSEMAP_H
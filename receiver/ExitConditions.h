@@ -1,4 +1,5 @@
-/// Function to be used as function pointers to check whether to exit followLine
+/// Conditions to check whether to exit the tracking algorithms, evaluated on the sample read by the algorithm on each loop.
+/// They are types rather than function pointers so that the compiler can inline them in the tracking loop
 /// \file ExitConditions.h
 /// \author Misha Krieger-Raynauld (1952515), Simon Gauvin (1951457), Vlad Drelciuc (1941366), Nicolas Charron (1960356)
 /// \date 2019-03-22
@@ -6,55 +7,212 @@
 #ifndef EXITCONDITIONS_H
 #define EXITCONDITIONS_H
 
+#include <stdint.h>
 #include "GeneralIo.h"
+#include "Timer.h"
+
+/// Data read once per loop by the tracking algorithms and shared with the exit conditions
+struct TrackerSample
+{
+    uint8_t lineTrackerValues; // The line tracker readings, as returned by readLineTrackerValues
+    uint16_t msElapsed; // The time elapsed since the tracking algorithm started
+};
+
+/// Return true when the sensors selected by the mask read the given value
+/// \tparam Mask    The sensors to check (leftmost sensor is the MSB)
+/// \tparam Value   The expected readings of the selected sensors (1 for black)
+template <uint8_t Mask, uint8_t Value>
+struct Pattern
+{
+    static_assert((Value & ~Mask) == 0, "Pattern value must only contain sensors of the mask");
+
+    bool operator()(const TrackerSample& sample) const
+    {
+        return (sample.lineTrackerValues & Mask) == Value;
+    }
+};
+
+/// Return true when the given condition is false
+template <typename Condition>
+class Not
+{
+public:
+    bool operator()(const TrackerSample& sample)
+    {
+        return !m_condition(sample);
+    }
+
+private:
+    Condition m_condition;
+};
+
+/// Return true when any of the given conditions is true
+template <typename... Conditions>
+class AnyOf;
+
+template <>
+class AnyOf<>
+{
+public:
+    bool operator()(const TrackerSample&) { return false; }
+};
+
+template <typename First, typename... Rest>
+class AnyOf<First, Rest...>
+{
+public:
+    bool operator()(const TrackerSample& sample)
+    {
+        // Evaluate every condition, without short-circuiting, so that conditions with a state see every sample
+        bool isFirstTrue = m_first(sample);
+        bool isAnyOfRestTrue = m_rest(sample);
+        return isFirstTrue || isAnyOfRestTrue;
+    }
+
+private:
+    First m_first;
+    AnyOf<Rest...> m_rest;
+};
+
+/// Return true when all of the given conditions are true
+template <typename... Conditions>
+class AllOf;
+
+template <>
+class AllOf<>
+{
+public:
+    bool operator()(const TrackerSample&) { return true; }
+};
+
+template <typename First, typename... Rest>
+class AllOf<First, Rest...>
+{
+public:
+    bool operator()(const TrackerSample& sample)
+    {
+        // Evaluate every condition, without short-circuiting, so that conditions with a state see every sample
+        bool isFirstTrue = m_first(sample);
+        bool isAllOfRestTrue = m_rest(sample);
+        return isFirstTrue && isAllOfRestTrue;
+    }
+
+private:
+    First m_first;
+    AllOf<Rest...> m_rest;
+};
+
+/// Return true once the given condition has been true for a number of consecutive samples. Useful to filter out noise
+/// \tparam NbSamples   The number of consecutive samples for which the condition must be true
+/// \tparam Condition   The condition to check
+template <uint8_t NbSamples, typename Condition>
+class HeldFor
+{
+public:
+    bool operator()(const TrackerSample& sample)
+    {
+        if (m_condition(sample))
+        {
+            if (m_nbSamples < NbSamples)
+            {
+                m_nbSamples++;
+            }
+        }
+        else
+        {
+            m_nbSamples = 0;
+        }
+        return m_nbSamples >= NbSamples;
+    }
+
+private:
+    Condition m_condition;
+    uint8_t m_nbSamples = 0;
+};
+
+/// Never return true (for testing, or for following for a set duration with Timeout)
+struct NeverStop
+{
+    bool operator()(const TrackerSample&) const { return false; }
+};
+
+/// Return true when the given condition is true or when the tracking algorithm has been running for a given duration
+/// \tparam MsDuration  The maximum duration, in milliseconds
+/// \tparam Condition   The condition to check. Default is NeverStop, to simply follow for the given duration
+template <uint16_t MsDuration, typename Condition = NeverStop>
+class Timeout
+{
+public:
+    bool operator()(const TrackerSample& sample)
+    {
+        bool isConditionTrue = m_condition(sample);
+        return isConditionTrue || sample.msElapsed >= MsDuration;
+    }
+
+private:
+    Condition m_condition;
+};
+
+/// Return true when the timer started with lib::startTimer() is expired
+struct TimerExpired
+{
+    bool operator()(const TrackerSample&) const { return lib::isTimerExpired; }
+};
 
-/// Read line tracker values and return true when three middle sensors are on white
-bool threeMiddleSensorsOnWhite();
-
-/// Read line tracker values and return true when three middle sensors are on black
-bool threeMiddleSensorsOnBlack();
+/// Return true if the ISR variable for the asynchronous button interrupt was set
+/// Note: requires lib::enableButtonInterrupts() to have been called beforehand
+struct ButtonPressed
+{
+    bool operator()(const TrackerSample&) const { return lib::wasButtonPressed; }
+};
 
-/// Read line tracker values and return true when three leftmost sensors are on black
-bool threeLeftSensorsOnBlack();
+/// Return true when three middle sensors are on white
+using ThreeMiddleSensorsOnWhite = Pattern<0b01110, 0b00000>;
 
-/// Read line tracker values and return true when all sensors are on white
-bool allSensorsOnWhite();
+/// Return true when three middle sensors are on black
+using ThreeMiddleSensorsOnBlack = Pattern<0b01110, 0b01110>;
 
-/// Read line tracker values and return true when any of the edge sensors is on black
-bool anyEdgeSensorOnBlack();
+/// Return true when three leftmost sensors are on black
+using ThreeLeftSensorsOnBlack = Pattern<0b11100, 0b11100>;
 
-/// Read line tracker values and return true when both edge sensors are on white
-bool bothEdgeSensorsOnWhite();
+/// Return true when all sensors are on white
+using AllSensorsOnWhite = Pattern<0b11111, 0b00000>;
 
-/// Read line tracker values and return true when left sensor is on white
-bool leftSensorOnWhite();
+/// Return true when any of the edge sensors is on black
+using AnyEdgeSensorOnBlack = AnyOf<Pattern<0b10000, 0b10000>, Pattern<0b00001, 0b00001>>;
 
-/// Read line tracker values and return true when right sensor is on white
-bool rightSensorOnWhite();
+/// Return true when both edge sensors are on white
+using BothEdgeSensorsOnWhite = Pattern<0b10001, 0b00000>;
 
-/// Read line tracker values and return true when both edge sensors are on black
-bool bothEdgeSensorsOnBlack();
+/// Return true when left sensor is on white
+using LeftSensorOnWhite = Pattern<0b10000, 0b00000>;
 
-/// Read line tracker values and return true when any of the sensors is on black
-bool anySensorOnBlack();
+/// Return true when right sensor is on white
+using RightSensorOnWhite = Pattern<0b00001, 0b00000>;
 
-/// Read line tracker values and return true when middle sensor is on black
-bool middleSensorOnBlack();
+/// Return true when both edge sensors are on black
+using BothEdgeSensorsOnBlack = Pattern<0b10001, 0b10001>;
 
-/// Read line tracker values and return true when first sensor is on black
-bool firstSensorOnBlack();
+/// Return true when any of the sensors is on black
+using AnySensorOnBlack = Not<AllSensorsOnWhite>;
 
-/// Read line tracker values and return true when second sensor is on black
-bool secondSensorOnBlack();
+/// Return true when middle sensor is on black
+using MiddleSensorOnBlack = Pattern<0b00100, 0b00100>;
 
-/// Return true when timer is expired
-bool timerExpired();
+/// Return true when first sensor is on black
+using FirstSensorOnBlack = Pattern<0b10000, 0b10000>;
 
-/// Return true if the ISR variable for the asynchronous button interrupt was set
-/// Note: requires lib::enableButtonInterrupts() to have been called beforehand
-bool buttonPressed();
+/// Return true when second sensor is on black
+using SecondSensorOnBlack = Pattern<0b01000, 0b01000>;
 
-/// Never return true (for testing)
-bool neverStop();
+/// Read line tracker values and evaluate a condition on them, for use outside of the tracking algorithms
+/// \tparam Condition The condition to evaluate. Its state, if any, is not kept between calls
+/// \return Whether the condition is true for the current line tracker readings
+template <typename Condition>
+bool checkLineTracker()
+{
+    Condition condition;
+    return condition(TrackerSample{lib::readLineTrackerValues(), 0});
+}
 
 #endif // EXITCONDITIONS_H
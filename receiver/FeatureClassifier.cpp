@@ -0,0 +1,177 @@
+/// Streaming detection of the course features (junctions, corners, rectangles) from the line tracker samples
+/// \file FeatureClassifier.cpp
+/// \author Misha Krieger-Raynauld (1952515), Simon Gauvin (1951457), Vlad Drelciuc (1941366), Nicolas Charron (1960356)
+/// \date 2019-04-05
+
+#include "FeatureClassifier.h"
+
+namespace
+{
+    constexpr uint8_t leftEdgeSensorMask = 0b10000;
+    constexpr uint8_t rightEdgeSensorMask = 0b00001;
+    constexpr uint8_t middleSensorsMask = 0b01110;
+
+    // Number of samples from which a feature is detected with full confidence
+    constexpr uint8_t nbFullConfidenceSamples = 4;
+
+    // Number of consecutive samples with the line alone under the middle sensors before a feature ends with the line
+    // continuing. Leaving a perpendicular edge at an angle clears the edge sensors a few samples before the middle ones
+    constexpr uint8_t nbLineAloneSamplesToEndFeature = 3;
+
+    // Maximum duration of an interruption of the line for it to be a gap rather than the end of the line
+    constexpr uint16_t msMaxGapDuration = 150;
+} // namespace
+
+FeatureClassifier::FeatureClassifier()
+    : m_isOnFeature(false)
+    , m_isLineInterrupted(false)
+    , m_isInterruptionReported(false)
+    , m_wasLeftEdgeOnBlack(false)
+    , m_wasRightEdgeOnBlack(false)
+    , m_isInsideRectangle(false)
+    , m_nbFeatureSamples(0)
+    , m_nbLineAloneSamples(0)
+    , m_msFeatureStart(0)
+{
+}
+
+void FeatureClassifier::reset()
+{
+    m_isOnFeature = false;
+    m_isLineInterrupted = false;
+    m_isInterruptionReported = false;
+    m_wasLeftEdgeOnBlack = false;
+    m_wasRightEdgeOnBlack = false;
+    m_isInsideRectangle = false;
+    m_nbFeatureSamples = 0;
+    m_nbLineAloneSamples = 0;
+    m_msFeatureStart = 0;
+}
+
+FeatureEvent FeatureClassifier::update(const TrackerSample& sample)
+{
+    bool isLeftEdgeOnBlack = (sample.lineTrackerValues & leftEdgeSensorMask) != 0;
+    bool isRightEdgeOnBlack = (sample.lineTrackerValues & rightEdgeSensorMask) != 0;
+    bool isMiddleOnBlack = (sample.lineTrackerValues & middleSensorsMask) != 0;
+
+    if (m_isOnFeature)
+    {
+        if (m_nbFeatureSamples < UINT8_MAX)
+        {
+            m_nbFeatureSamples++;
+        }
+        m_wasLeftEdgeOnBlack |= isLeftEdgeOnBlack;
+        m_wasRightEdgeOnBlack |= isRightEdgeOnBlack;
+
+        // The feature ends right away when the line ends, but only once the line has been alone for a few samples when it
+        // continues, as the middle sensors may still be about to leave the feature
+        bool hasLineEnded = (isMiddleOnBlack == false);
+        bool isLineAlone = (isLeftEdgeOnBlack == false && isRightEdgeOnBlack == false);
+        m_nbLineAloneSamples = (isLineAlone && hasLineEnded == false) ? m_nbLineAloneSamples + 1 : 0;
+        if (hasLineEnded == false && m_nbLineAloneSamples < nbLineAloneSamplesToEndFeature)
+        {
+            return makeEvent(Feature::None);
+        }
+        m_isOnFeature = false;
+        m_nbLineAloneSamples = 0;
+
+        Feature feature;
+        if (m_wasLeftEdgeOnBlack && m_wasRightEdgeOnBlack)
+        {
+            if (m_isInsideRectangle)
+            {
+                m_isInsideRectangle = false;
+                feature = Feature::RectangleExit;
+            }
+            else if (hasLineEnded)
+            {
+                m_isInsideRectangle = true;
+                feature = Feature::RectangleEntry;
+            }
+            else
+            {
+                feature = Feature::TJunction;
+            }
+        }
+        // The sides of a rectangle are not features
+        else if (m_isInsideRectangle)
+        {
+            feature = Feature::None;
+        }
+        else if (m_wasLeftEdgeOnBlack)
+        {
+            feature = hasLineEnded ? Feature::LeftCorner : Feature::LeftBranch;
+        }
+        else
+        {
+            feature = hasLineEnded ? Feature::RightCorner : Feature::RightBranch;
+        }
+        FeatureEvent event = makeEvent(feature);
+
+        // The line ending after the feature is explained by the feature, so it is neither a gap nor the end of the line
+        if (hasLineEnded)
+        {
+            m_isLineInterrupted = true;
+            m_isInterruptionReported = true;
+        }
+        return event;
+    }
+
+    // Start a feature when an edge sensor sees black
+    if (isLeftEdgeOnBlack || isRightEdgeOnBlack)
+    {
+        m_isOnFeature = true;
+        m_isLineInterrupted = false;
+        m_wasLeftEdgeOnBlack = isLeftEdgeOnBlack;
+        m_wasRightEdgeOnBlack = isRightEdgeOnBlack;
+        m_nbFeatureSamples = 1;
+        m_nbLineAloneSamples = 0;
+        m_msFeatureStart = sample.msElapsed;
+        return makeEvent(Feature::None);
+    }
+
+    if (isMiddleOnBlack == false)
+    {
+        if (m_isLineInterrupted == false)
+        {
+            m_isLineInterrupted = true;
+            m_isInterruptionReported = false;
+            m_nbFeatureSamples = 0;
+            m_msFeatureStart = sample.msElapsed;
+        }
+        if (m_nbFeatureSamples < UINT8_MAX)
+        {
+            m_nbFeatureSamples++;
+        }
+
+        // Report the end of the line once, when the interruption becomes too long to be a gap
+        if (m_isInterruptionReported == false &&
+            static_cast<uint16_t>(sample.msElapsed - m_msFeatureStart) >= msMaxGapDuration)
+        {
+            m_isInterruptionReported = true;
+            return makeEvent(Feature::LineEnd);
+        }
+        return makeEvent(Feature::None);
+    }
+
+    // The line is back after a short interruption
+    if (m_isLineInterrupted)
+    {
+        m_isLineInterrupted = false;
+        if (m_isInterruptionReported == false)
+        {
+            return makeEvent(Feature::Gap);
+        }
+    }
+    return makeEvent(Feature::None);
+}
+
+FeatureEvent FeatureClassifier::makeEvent(Feature feature) const
+{
+    uint8_t confidence = 100;
+    if (m_nbFeatureSamples < nbFullConfidenceSamples)
+    {
+        confidence = static_cast<uint16_t>(m_nbFeatureSamples) * 100 / nbFullConfidenceSamples;
+    }
+    return {feature, confidence, m_msFeatureStart};
+}
@@ -0,0 +1,91 @@
+/// Streaming detection of the course features (junctions, corners, rectangles) from the line tracker samples
+/// \file FeatureClassifier.h
+/// \author Misha Krieger-Raynauld (1952515), Simon Gauvin (1951457), Vlad Drelciuc (1941366), Nicolas Charron (1960356)
+/// \date 2019-04-05
+
+#ifndef FEATURECLASSIFIER_H
+#define FEATURECLASSIFIER_H
+
+#include <stdint.h>
+#include "ExitConditions.h"
+
+/// Course features which can be detected while following a line
+enum class Feature : uint8_t
+{
+    None,
+    TJunction, // Black on both sides of the line, after which the line continues
+    LeftBranch, // Black on the left of the line, after which the line continues
+    RightBranch, // Black on the right of the line, after which the line continues
+    LeftCorner, // Black on the left of the line, after which the line ends: the line turns left
+    RightCorner, // Black on the right of the line, after which the line ends: the line turns right
+    LineEnd, // The line ended without anything on its sides
+    Gap, // The line was interrupted for a short time
+    RectangleEntry, // Black on both sides of the line, after which the line ends. A T at the end of a line also looks like this
+    RectangleExit // Black on both sides of the line after a rectangle entry
+};
+
+/// Feature detected by the classifier
+struct FeatureEvent
+{
+    Feature feature;
+    uint8_t confidence; // From 0 to 100, according to the number of samples on which the feature was seen
+    uint16_t msTime; // Time of the sample where the feature started, in the time base of the samples
+};
+
+/// Classify the course features from a stream of line tracker samples without needing the robot to stop.
+/// A feature starts when an edge sensor sees black (or when the line disappears) and is classified once it ends,
+/// according to which edges saw black and whether the line continues after it. A feature after which the line continues
+/// only ends after a few samples with the line alone, so that it is not confused with the end of the line
+class FeatureClassifier
+{
+public:
+    /// Constructor
+    FeatureClassifier();
+
+    /// Forget the current feature, the interruptions of the line and whether the robot is inside a rectangle
+    void reset();
+
+    /// Classify the latest sample. To be called on every read of the sensors
+    /// \param sample The latest line tracker readings and their time
+    /// \return The feature which just ended, or a feature of type Feature::None
+    FeatureEvent update(const TrackerSample& sample);
+
+    /// Get whether the robot is between a rectangle entry and a rectangle exit
+    /// \return Whether the robot is inside a rectangle
+    bool isInsideRectangle() const { return m_isInsideRectangle; }
+
+private:
+    /// Build an event from the current feature
+    /// \param feature The type of the feature
+    /// \return The event for the feature
+    FeatureEvent makeEvent(Feature feature) const;
+
+    bool m_isOnFeature; // Whether an edge sensor saw black and the feature did not end yet
+    bool m_isLineInterrupted; // Whether the line is not under the middle sensors
+    bool m_isInterruptionReported; // Whether the interruption was reported as the end of the line or explained by a feature
+    bool m_wasLeftEdgeOnBlack;
+    bool m_wasRightEdgeOnBlack;
+    bool m_isInsideRectangle;
+    uint8_t m_nbFeatureSamples;
+    uint8_t m_nbLineAloneSamples; // Number of consecutive samples with the line alone since the edges left the feature
+    uint16_t m_msFeatureStart;
+};
+
+/// Exit condition returning true when the given feature is detected (see ExitConditions.h)
+/// \tparam DetectedFeature The feature to detect
+/// \tparam MinConfidence   The minimum confidence of the detection. Default is 0 to exit on any detection
+template <Feature DetectedFeature, uint8_t MinConfidence = 0>
+class FeatureDetected
+{
+public:
+    bool operator()(const TrackerSample& sample)
+    {
+        FeatureEvent event = m_classifier.update(sample);
+        return event.feature == DetectedFeature && event.confidence >= MinConfidence;
+    }
+
+private:
+    FeatureClassifier m_classifier;
+};
+
+#endif // FEATURECLASSIFIER_H
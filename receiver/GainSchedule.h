@@ -0,0 +1,52 @@
+/// Scaling of the tracking corrections with the speed of the robot
+/// \file GainSchedule.h
+/// \author Misha Krieger-Raynauld (1952515), Simon Gauvin (1951457), Vlad Drelciuc (1941366), Nicolas Charron (1960356)
+/// \date 2019-04-06
+
+#ifndef GAINSCHEDULE_H
+#define GAINSCHEDULE_H
+
+#include <stdint.h>
+
+/// Speed of the first point of the gain schedule, and spacing between the points (a power of 2 to interpolate with shifts)
+constexpr int16_t gainScheduleFirstSpeed = 64;
+constexpr uint8_t gainScheduleSpeedShift = 6;
+
+/// Relative correction gain at speeds 64, 128, 192 and 256, in 64ths. The same correction turns the robot less at a higher
+/// speed and the line moves more between two reads of the sensors, so the gain grows faster than the speed
+constexpr uint8_t trackingGains[] = {40, 64, 100, 144};
+constexpr uint8_t nbTrackingGains = sizeof(trackingGains) / sizeof(trackingGains[0]);
+
+/// Get the relative correction gain at a given speed, linearly interpolated between the points of the schedule
+/// \param speed The base speed of the robot
+/// \return The gain, in 64ths
+constexpr uint16_t getTrackingGain(int16_t speed)
+{
+    if (speed <= gainScheduleFirstSpeed)
+    {
+        return trackingGains[0];
+    }
+
+    uint16_t speedOffset = speed - gainScheduleFirstSpeed;
+    uint8_t index = speedOffset >> gainScheduleSpeedShift;
+    if (index >= nbTrackingGains - 1)
+    {
+        return trackingGains[nbTrackingGains - 1];
+    }
+
+    uint8_t fraction = speedOffset & ((1 << gainScheduleSpeedShift) - 1);
+    int16_t gainDifference = trackingGains[index + 1] - trackingGains[index];
+    return trackingGains[index] + ((gainDifference * fraction) >> gainScheduleSpeedShift);
+}
+
+/// Scale a gain tuned at a given speed for use at another speed
+/// \param gain         The gain, as tuned
+/// \param tunedSpeed   The speed at which the gain was tuned
+/// \param speed        The speed at which the gain is used
+/// \return The scaled gain, equal to the given gain when both speeds are equal
+constexpr int16_t scheduleGain(int16_t gain, int16_t tunedSpeed, int16_t speed)
+{
+    return static_cast<int32_t>(gain) * getTrackingGain(speed) / getTrackingGain(tunedSpeed);
+}
+
+#endif // GAINSCHEDULE_H
@@ -0,0 +1,60 @@
+/// Lookup of the tracking error corresponding to each line tracker sensor pattern
+/// \file LineErrors.cpp
+/// \author Misha Krieger-Raynauld (1952515), Simon Gauvin (1951457), Vlad Drelciuc (1941366), Nicolas Charron (1960356)
+/// \date 2019-04-02
+
+#include "LineErrors.h"
+#include <avr/pgmspace.h>
+
+namespace
+{
+    // Line following: the further a sensor is from the center, the bigger the error
+    constexpr int8_t lineSensorWeights[lib::nbLineTrackerSensors] = {-4, -2, 0, 2, 4};
+    constexpr PatternError lineSpecialPatterns[] = {
+        {0b00111, 3}, // Line leaving on the right side
+        {0b11100, -3}, // Line leaving on the left side
+        {0b00101, 1}, // Split readings, trust the sensor closest to the center
+        {0b10100, -1},
+        {0b01111, 0}, // Branches and T's, which must not pull the robot to one side
+        {0b11110, 0},
+        {0b11101, 0},
+        {0b10111, 0}
+    };
+
+    // Rectangle following: the edge sensors detect the rectangle sides, and the inner sensors detect them
+    // only when the robot is further off course, hence the bigger weights
+    constexpr int8_t rectangleSensorWeights[lib::nbLineTrackerSensors] = {1, 3, 0, -3, -1};
+    constexpr PatternError rectangleSpecialPatterns[] = {
+        {0b00000, 0} // Inside the rectangle without touching its sides
+    };
+
+    // Tables stored in flash, read with a single load per call
+    constexpr ErrorTable lineErrorTable PROGMEM = makeErrorTable(lineSensorWeights, lineSpecialPatterns, lineNotFoundError);
+    constexpr ErrorTable rectangleErrorTable PROGMEM = makeErrorTable(rectangleSensorWeights, rectangleSpecialPatterns, 0);
+
+    // Check that the generated tables keep the errors of the patterns seen on the course
+    static_assert(lineErrorTable.errors[0b00001] == 4 && lineErrorTable.errors[0b00011] == 3 &&
+                  lineErrorTable.errors[0b00010] == 2 && lineErrorTable.errors[0b00110] == 1 &&
+                  lineErrorTable.errors[0b00100] == 0 && lineErrorTable.errors[0b01110] == 0 &&
+                  lineErrorTable.errors[0b11111] == 0 && lineErrorTable.errors[0b01100] == -1 &&
+                  lineErrorTable.errors[0b01000] == -2 && lineErrorTable.errors[0b11000] == -3 &&
+                  lineErrorTable.errors[0b10000] == -4 && lineErrorTable.errors[0b00000] == lineNotFoundError,
+                  "Unexpected line error table");
+    static_assert(rectangleErrorTable.errors[0b01000] == 3 && rectangleErrorTable.errors[0b11000] == 2 &&
+                  rectangleErrorTable.errors[0b10000] == 1 && rectangleErrorTable.errors[0b00100] == 0 &&
+                  rectangleErrorTable.errors[0b01110] == 0 && rectangleErrorTable.errors[0b11110] == 0 &&
+                  rectangleErrorTable.errors[0b01111] == 0 && rectangleErrorTable.errors[0b11111] == 0 &&
+                  rectangleErrorTable.errors[0b00001] == -1 && rectangleErrorTable.errors[0b00011] == -2 &&
+                  rectangleErrorTable.errors[0b00010] == -3,
+                  "Unexpected rectangle error table");
+} // namespace
+
+int8_t getLineError(uint8_t lineTrackerValues)
+{
+    return static_cast<int8_t>(pgm_read_byte(&lineErrorTable.errors[lineTrackerValues & (nbLineTrackerPatterns - 1)]));
+}
+
+int8_t getRectangleError(uint8_t lineTrackerValues)
+{
+    return static_cast<int8_t>(pgm_read_byte(&rectangleErrorTable.errors[lineTrackerValues & (nbLineTrackerPatterns - 1)]));
+}
@@ -0,0 +1,80 @@
+/// Lookup of the tracking error corresponding to each line tracker sensor pattern
+/// \file LineErrors.h
+/// \author Misha Krieger-Raynauld (1952515), Simon Gauvin (1951457), Vlad Drelciuc (1941366), Nicolas Charron (1960356)
+/// \date 2019-04-02
+
+#ifndef LINEERRORS_H
+#define LINEERRORS_H
+
+#include <stdint.h>
+#include "GeneralIo.h"
+
+/// Error returned when no sensor sees the line
+constexpr int8_t lineNotFoundError = -128;
+
+/// Number of possible line tracker sensor patterns
+constexpr uint8_t nbLineTrackerPatterns = 1 << lib::nbLineTrackerSensors;
+
+/// Sensor pattern whose error must differ from the weighted average of its sensors
+struct PatternError
+{
+    uint8_t pattern;
+    int8_t error;
+};
+
+/// Error for every possible line tracker sensor pattern, indexed by the pattern
+struct ErrorTable
+{
+    int8_t errors[nbLineTrackerPatterns];
+};
+
+/// Generate the error of every sensor pattern from a declarative description. Each pattern gets the average of the
+/// weights of its sensors on black (truncated towards zero), unless it is listed as a special pattern.
+/// Since every pattern is computed, changing a weight or the number of sensors cannot leave a pattern unhandled
+/// \param weights                  The error contributed by each sensor, from the leftmost to the rightmost
+/// \param specialPatterns          The patterns whose error overrides the weighted average
+/// \param noSensorOnBlackError     The error for the pattern where every sensor is on white
+/// \return The generated error table
+template <uint8_t NbSpecialPatterns>
+constexpr ErrorTable makeErrorTable(const int8_t (&weights)[lib::nbLineTrackerSensors],
+                                    const PatternError (&specialPatterns)[NbSpecialPatterns],
+                                    int8_t noSensorOnBlackError)
+{
+    ErrorTable table{};
+    for (uint8_t pattern = 0; pattern < nbLineTrackerPatterns; pattern++)
+    {
+        int16_t weightSum = 0;
+        uint8_t nbSensorsOnBlack = 0;
+        for (uint8_t i = 0; i < lib::nbLineTrackerSensors; i++)
+        {
+            // Same bit order as readLineTrackerValues (leftmost sensor is the MSB)
+            if (pattern & (1 << (lib::nbLineTrackerSensors - 1 - i)))
+            {
+                weightSum += weights[i];
+                nbSensorsOnBlack++;
+            }
+        }
+        table.errors[pattern] = (nbSensorsOnBlack == 0) ? noSensorOnBlackError : weightSum / nbSensorsOnBlack;
+    }
+
+    for (const PatternError& specialPattern : specialPatterns)
+    {
+        table.errors[specialPattern.pattern] = specialPattern.error;
+    }
+    return table;
+}
+
+/// Get error between desired setpoint for following a line and the given line tracker sensor readings
+/// \param lineTrackerValues 8-bit unsigned int whose bit represents the line tracker sensor readings
+/// \return The error between the center and the current position for use with a PID controller.
+///         Positive values mean the robot is off course towards the left, negative towards the right.
+///         If no sensor sees the line, lineNotFoundError is returned
+int8_t getLineError(uint8_t lineTrackerValues);
+
+/// Get error between desired setpoint for following a rectangle and the given line tracker sensor readings
+/// \param lineTrackerValues 8-bit unsigned int whose bit represents the line tracker sensor readings
+/// \return The error between the rectangle alignment and the current position for use with a PID controller.
+///         Positive values mean the robot is off course towards the left, negative towards the right
+int8_t getRectangleError(uint8_t lineTrackerValues);
+
+#endif // LINEERRORS_H
@@ -0,0 +1,126 @@
+/// Estimation of the position of the line and of the heading of the robot from the line sensors and the motor commands
+/// \file LineEstimator.cpp
+/// \author Misha Krieger-Raynauld (1952515), Simon Gauvin (1951457), Vlad Drelciuc (1941366), Nicolas Charron (1960356)
+/// \date 2019-04-06
+
+#include "LineEstimator.h"
+#include "LineErrors.h"
+#include "Timer.h"
+
+namespace
+{
+    // Offsets are in sixteenths of line error for precision
+    constexpr uint8_t offsetShift = 4;
+
+    // The offset is kept within a few errors beyond the sensors, past which the estimate is meaningless anyway
+    constexpr int16_t maxOffset = 8 << offsetShift;
+    constexpr int16_t maxHeading = 4096;
+
+    // Heading change caused by the wheel differential, and offset change caused by the sensors being ahead of the wheels:
+    // a differential of 512 changes each of them by one unit per millisecond. Hand-tuned on the course, not derived from
+    // the calibrated rotation timings
+    constexpr uint8_t differentialShift = 9;
+
+    // Offset drift caused by the heading: the heading is in 256ths of drift per millisecond at a duty cycle of 128
+    constexpr uint8_t headingDriftShift = 15;
+
+    // Weight of a measurement compared to the model: the offset moves halfway to the measured error
+    constexpr uint8_t offsetCorrectionShift = 1;
+
+    // Part of the unexpected movement of the line attributed to a wrong heading
+    constexpr uint8_t headingCorrectionShift = 2;
+
+    // Minimum forward duty cycle for the unexpected movement of the line to tell anything about the heading
+    constexpr int16_t minHeadingCorrectionSpeed = 40;
+
+    // Maximum time without seeing the line during which the estimate is still trusted
+    constexpr uint16_t msMaxWithoutLineDuration = 250;
+
+    /// Clamp a value within a symmetric range
+    /// \param value    The value to clamp
+    /// \param maxValue The maximum absolute value
+    /// \return The clamped value
+    int16_t clamp(int32_t value, int16_t maxValue)
+    {
+        if (value > maxValue)
+        {
+            return maxValue;
+        }
+        if (value < -maxValue)
+        {
+            return -maxValue;
+        }
+        return value;
+    }
+} // namespace
+
+LineEstimator::LineEstimator()
+    : m_offset(0)
+    , m_heading(0)
+    , m_msLastUpdate(0)
+    , m_msWithoutLine(0)
+    , m_hasSeenLine(false)
+{
+}
+
+void LineEstimator::reset()
+{
+    m_offset = 0;
+    m_heading = 0;
+    m_msWithoutLine = 0;
+    m_hasSeenLine = false;
+}
+
+void LineEstimator::update(int8_t lineError, int16_t leftMotorSpeed, int16_t rightMotorSpeed)
+{
+    uint16_t msNow = lib::getMilliseconds();
+    uint16_t msElapsed = msNow - m_msLastUpdate;
+    m_msLastUpdate = msNow;
+
+    if (m_hasSeenLine == false)
+    {
+        if (lineError != lineNotFoundError)
+        {
+            m_offset = static_cast<int16_t>(lineError) << offsetShift;
+            m_heading = 0;
+            m_msWithoutLine = 0;
+            m_hasSeenLine = true;
+        }
+        return;
+    }
+
+    // Predict with the motor commands since the last update
+    int16_t wheelDifferential = leftMotorSpeed - rightMotorSpeed;
+    int16_t forwardSpeed = (leftMotorSpeed + rightMotorSpeed) / 2;
+    int32_t differentialChange = static_cast<int32_t>(wheelDifferential) * msElapsed >> differentialShift;
+    m_heading = clamp(m_heading + differentialChange, maxHeading);
+    int32_t headingDrift = static_cast<int32_t>(m_heading) * forwardSpeed * msElapsed >> headingDriftShift;
+    int16_t predictedOffset = clamp(m_offset - headingDrift - differentialChange, maxOffset);
+
+    if (lineError == lineNotFoundError)
+    {
+        m_offset = predictedOffset;
+        if (m_msWithoutLine < msMaxWithoutLineDuration)
+        {
+            m_msWithoutLine += msElapsed;
+        }
+        return;
+    }
+    m_msWithoutLine = 0;
+
+    // Correct with the measurement
+    int16_t innovation = (static_cast<int16_t>(lineError) << offsetShift) - predictedOffset;
+    m_offset = predictedOffset + (innovation >> offsetCorrectionShift);
+
+    // The line moving right more than expected means the robot is heading more to the left than estimated
+    if (forwardSpeed >= minHeadingCorrectionSpeed && msElapsed > 0)
+    {
+        int32_t headingError = (static_cast<int32_t>(innovation) << headingDriftShift) / (static_cast<int32_t>(forwardSpeed) * msElapsed);
+        m_heading = clamp(m_heading - (headingError >> headingCorrectionShift), maxHeading);
+    }
+}
+
+bool LineEstimator::isValid() const
+{
+    return m_hasSeenLine && m_msWithoutLine < msMaxWithoutLineDuration;
+}
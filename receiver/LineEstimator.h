@@ -0,0 +1,51 @@
+/// Estimation of the position of the line and of the heading of the robot from the line sensors and the motor commands
+/// \file LineEstimator.h
+/// \author Misha Krieger-Raynauld (1952515), Simon Gauvin (1951457), Vlad Drelciuc (1941366), Nicolas Charron (1960356)
+/// \date 2019-04-06
+
+#ifndef LINEESTIMATOR_H
+#define LINEESTIMATOR_H
+
+#include <stdint.h>
+
+/// Fixed point complementary filter fusing the coarse line error of the sensors with the motor duty cycles.
+/// Between two reads, the heading of the robot relative to the line is integrated from the wheel differential and the
+/// offset of the line from the heading and the forward speed. Each read then pulls the offset towards the measured error
+/// and corrects the heading with the part of the movement of the line that the model did not expect.
+/// When the sensors do not see the line, the model alone keeps estimating for a short time
+class LineEstimator
+{
+public:
+    /// Constructor
+    LineEstimator();
+
+    /// Forget the estimate, for example after the robot did something else than following the line
+    void reset();
+
+    /// Update the estimate with the latest line error and motor commands. To be called once per read of the sensors
+    /// \param lineError        The latest line error, from getLineError, or lineNotFoundError
+    /// \param leftMotorSpeed   The duty cycle of the left motor
+    /// \param rightMotorSpeed  The duty cycle of the right motor
+    void update(int8_t lineError, int16_t leftMotorSpeed, int16_t rightMotorSpeed);
+
+    /// Get whether the estimate can be used: the line was seen since the last reset and not lost for too long
+    /// \return Whether the estimate is valid
+    bool isValid() const;
+
+    /// Get the estimated position of the line under the sensors
+    /// \return The offset, in sixteenths of line error (positive when the line is on the right)
+    int16_t getOffset() const { return m_offset; }
+
+    /// Get the estimated heading of the robot relative to the line
+    /// \return The heading, in 256ths of the offset drift per millisecond at a duty cycle of 128 (positive when turned right)
+    int16_t getHeading() const { return m_heading; }
+
+private:
+    int16_t m_offset;
+    int16_t m_heading;
+    uint16_t m_msLastUpdate;
+    uint16_t m_msWithoutLine;
+    bool m_hasSeenLine;
+};
+
+#endif // LINEESTIMATOR_H
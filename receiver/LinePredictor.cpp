@@ -0,0 +1,104 @@
+/// Prediction of the line position at the time the next motor command takes effect
+/// \file LinePredictor.cpp
+/// \author Misha Krieger-Raynauld (1952515), Simon Gauvin (1951457), Vlad Drelciuc (1941366), Nicolas Charron (1960356)
+/// \date 2019-04-05
+
+#include "LinePredictor.h"
+#include "LineErrors.h"
+#include "Timer.h"
+
+namespace
+{
+    // Positions are stored in sixteenths of line error for precision
+    constexpr uint8_t positionShift = 4;
+
+    // Biggest error returned by getLineError
+    constexpr int8_t maxLineError = 4;
+    constexpr int16_t maxPosition = maxLineError << positionShift;
+
+    // Movement of the line under the sensors caused by the wheel differential: a differential of 512 moves the line by one
+    // sixteenth of error per millisecond. Hand-tuned while following lines rather than measured
+    constexpr uint8_t differentialVelocityShift = 9;
+} // namespace
+
+LinePredictor::LinePredictor()
+    : m_positions()
+    , m_msTimes()
+    , m_nextIndex(0)
+    , m_nbPositions(0)
+    , m_msLatency(0)
+    , m_predictedPosition(0)
+{
+}
+
+void LinePredictor::reset()
+{
+    m_nextIndex = 0;
+    m_nbPositions = 0;
+    m_msLatency = 0;
+    m_predictedPosition = 0;
+}
+
+int8_t LinePredictor::update(int8_t lineError, int16_t wheelDifferential)
+{
+    uint16_t msNow = lib::getMilliseconds();
+
+    // Measure the time between loops, which is the time before the next reading can correct a command
+    if (m_nbPositions > 0)
+    {
+        uint8_t previousIndex = (m_nextIndex == 0) ? nbHistoryPositions - 1 : m_nextIndex - 1;
+        uint16_t msLoopDuration = msNow - m_msTimes[previousIndex];
+        m_msLatency = (m_msLatency == 0) ? msLoopDuration : (3 * m_msLatency + msLoopDuration) >> 2;
+    }
+
+    // Nothing to extrapolate when the line is lost, and the history would span the interruption
+    if (lineError == lineNotFoundError)
+    {
+        m_nextIndex = 0;
+        m_nbPositions = 0;
+        return lineNotFoundError;
+    }
+
+    int16_t position = static_cast<int16_t>(lineError) << positionShift;
+
+    // Velocity observed over the history, oldest position first
+    int32_t observedDisplacement = 0;
+    if (m_nbPositions > 0)
+    {
+        uint8_t oldestIndex = (m_nbPositions < nbHistoryPositions) ? 0 : m_nextIndex;
+        uint16_t msHistoryDuration = msNow - m_msTimes[oldestIndex];
+        if (msHistoryDuration > 0)
+        {
+            observedDisplacement = static_cast<int32_t>(position - m_positions[oldestIndex]) * m_msLatency / msHistoryDuration;
+        }
+    }
+
+    // Velocity expected from the current command, which the history does not show yet. Turning right (positive differential)
+    // moves the line to the left of the sensors
+    int32_t commandedDisplacement = -(static_cast<int32_t>(wheelDifferential) * m_msLatency >> differentialVelocityShift);
+
+    // Blend both estimates: the observation is noisy because of the quantized positions and the model ignores slipping
+    int32_t predictedPosition = position + ((observedDisplacement + commandedDisplacement) >> 1);
+    if (predictedPosition > maxPosition)
+    {
+        predictedPosition = maxPosition;
+    }
+    else if (predictedPosition < -maxPosition)
+    {
+        predictedPosition = -maxPosition;
+    }
+    m_predictedPosition = predictedPosition;
+
+    // Record the position
+    m_positions[m_nextIndex] = position;
+    m_msTimes[m_nextIndex] = msNow;
+    m_nextIndex = (m_nextIndex + 1 == nbHistoryPositions) ? 0 : m_nextIndex + 1;
+    if (m_nbPositions < nbHistoryPositions)
+    {
+        m_nbPositions++;
+    }
+
+    // Round to the nearest error
+    int16_t roundingOffset = (m_predictedPosition < 0) ? -(1 << (positionShift - 1)) : (1 << (positionShift - 1));
+    return (m_predictedPosition + roundingOffset) / (1 << positionShift);
+}
@@ -0,0 +1,49 @@
+/// Prediction of the line position at the time the next motor command takes effect
+/// \file LinePredictor.h
+/// \author Misha Krieger-Raynauld (1952515), Simon Gauvin (1951457), Vlad Drelciuc (1941366), Nicolas Charron (1960356)
+/// \date 2019-04-05
+
+#ifndef LINEPREDICTOR_H
+#define LINEPREDICTOR_H
+
+#include <stdint.h>
+
+/// Extrapolate the line error forward by the measured loop latency. The sensors are read once per loop, so a command computed
+/// from a reading acts on a line position which is already one loop old. The predictor estimates how fast the line moves under
+/// the sensors from the last few positions and from the commanded wheel differential, and returns where the line will be
+/// by the time the next reading can correct the command
+class LinePredictor
+{
+public:
+    /// Constructor
+    LinePredictor();
+
+    /// Forget the position history and the measured latency
+    void reset();
+
+    /// Record the latest line error and predict it. To be called once per loop, right after reading the sensors
+    /// \param lineError            The latest line error, from getLineError, or lineNotFoundError
+    /// \param wheelDifferential    The difference between the left and the right motor duty cycles
+    /// \return The predicted line error, rounded and clamped to the range of getLineError, or lineNotFoundError if the line is lost
+    int8_t update(int8_t lineError, int16_t wheelDifferential);
+
+    /// Get the last predicted line position with more precision than the rounded error
+    /// \return The predicted line position, in sixteenths of line error
+    int16_t getPredictedPosition() const { return m_predictedPosition; }
+
+    /// Get the measured loop latency
+    /// \return The average time between two updates, in milliseconds
+    uint16_t getLatency() const { return m_msLatency; }
+
+private:
+    static constexpr uint8_t nbHistoryPositions = 4;
+
+    int16_t m_positions[nbHistoryPositions]; // Sixteenths of line error
+    uint16_t m_msTimes[nbHistoryPositions];
+    uint8_t m_nextIndex;
+    uint8_t m_nbPositions;
+    uint16_t m_msLatency;
+    int16_t m_predictedPosition;
+};
+
+#endif // LINEPREDICTOR_H
@@ -0,0 +1,122 @@
+/// Bounded search for the line after it was lost by the tracking algorithms
+/// \file LineSearch.cpp
+/// \author Misha Krieger-Raynauld (1952515), Simon Gauvin (1951457), Vlad Drelciuc (1941366), Nicolas Charron (1960356)
+/// \date 2019-04-04
+
+#include "LineSearch.h"
+#include "Motors.h"
+#include "Timer.h"
+
+namespace
+{
+    // Amplitude of the first sweep, on the side where the line was last going
+    constexpr uint8_t firstSweepDegrees = 20;
+
+    // Amplitude added to each following sweep, on alternating sides
+    constexpr uint8_t sweepIncrementDegrees = 30;
+
+    // Angle budget: the search fails instead of sweeping further than this on either side
+    constexpr uint8_t maxSweepDegrees = 120;
+
+    // Time budget of the search
+    constexpr uint16_t msSearchBudget = 3000;
+
+    // The line is found when any of the three middle sensors is on black
+    constexpr uint8_t middleSensorsMask = 0b01110;
+
+    /// Convert an angle to the time needed to rotate by it at the calibrated rotation speed
+    /// \param degrees The angle, in degrees
+    /// \return The rotation duration, in milliseconds
+    int16_t degreesToRotationDuration(uint8_t degrees)
+    {
+        return static_cast<uint32_t>(degrees) * (lib::msRotate90ClockwiseDuration + lib::msRotate90CounterclockwiseDuration) / 180;
+    }
+} // namespace
+
+LineSearch::LineSearch()
+    : m_msStart(0)
+    , m_msLastUpdate(0)
+    , m_msRotation(0)
+    , m_msSweepAmplitude(0)
+    , m_msSweepAmplitudeIncrement(0)
+    , m_msMaxSweepAmplitude(0)
+    , m_isTurningClockwise(true)
+{
+}
+
+void LineSearch::start(int8_t lastLineError, int8_t lastLineErrorVariation, bool lastSeenSideIsRight)
+{
+    m_msStart = lib::getMilliseconds();
+    m_msLastUpdate = m_msStart;
+    m_msRotation = 0;
+
+    // Convert the angles here as the rotation timings are read from the external EEPROM after startup
+    m_msSweepAmplitude = degreesToRotationDuration(firstSweepDegrees);
+    m_msSweepAmplitudeIncrement = degreesToRotationDuration(sweepIncrementDegrees);
+    m_msMaxSweepAmplitude = degreesToRotationDuration(maxSweepDegrees);
+
+    // Start on the side where the line should be now, from where it was and where it was going
+    int16_t predictedLineError = lastLineError + lastLineErrorVariation;
+    if (predictedLineError > 0)
+    {
+        startSweep(true);
+    }
+    else if (predictedLineError < 0)
+    {
+        startSweep(false);
+    }
+    else
+    {
+        startSweep(lastSeenSideIsRight);
+    }
+}
+
+LineSearchStatus LineSearch::update(uint8_t lineTrackerValues)
+{
+    if ((lineTrackerValues & middleSensorsMask) != 0)
+    {
+        return LineSearchStatus::Found;
+    }
+
+    // Integrate the rotation with the real time elapsed, as the time between updates depends on the caller
+    uint16_t msNow = lib::getMilliseconds();
+    int16_t msElapsed = msNow - m_msLastUpdate;
+    m_msLastUpdate = msNow;
+    m_msRotation += m_isTurningClockwise ? msElapsed : -msElapsed;
+
+    if (static_cast<uint16_t>(msNow - m_msStart) >= msSearchBudget)
+    {
+        return LineSearchStatus::Failed;
+    }
+
+    // Reverse with a bigger amplitude once the end of the current sweep is reached
+    bool isSweepDone = m_isTurningClockwise ? (m_msRotation >= m_msSweepAmplitude) : (m_msRotation <= -m_msSweepAmplitude);
+    if (isSweepDone)
+    {
+        m_msSweepAmplitude += m_msSweepAmplitudeIncrement;
+        if (m_msSweepAmplitude > m_msMaxSweepAmplitude)
+        {
+            return LineSearchStatus::Failed;
+        }
+        startSweep(m_isTurningClockwise == false);
+    }
+
+    return LineSearchStatus::Searching;
+}
+
+void LineSearch::startSweep(bool isClockwise)
+{
+    m_isTurningClockwise = isClockwise;
+
+    // Kickstart the motors as they must reverse, the pulse is counted in the rotation by the next update.
+    // The pulse runs in the background so that the line can be found during it, and a short sweep may cancel the previous pulse
+    lib::abortMotion();
+    if (isClockwise)
+    {
+        lib::queueMotorPulse(lib::calibratedRotationSpeed, -lib::calibratedRotationSpeed);
+    }
+    else
+    {
+        lib::queueMotorPulse(-lib::calibratedRotationSpeed, lib::calibratedRotationSpeed);
+    }
+}
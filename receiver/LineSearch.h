@@ -0,0 +1,54 @@
+/// Bounded search for the line after it was lost by the tracking algorithms
+/// \file LineSearch.h
+/// \author Misha Krieger-Raynauld (1952515), Simon Gauvin (1951457), Vlad Drelciuc (1941366), Nicolas Charron (1960356)
+/// \date 2019-04-04
+
+#ifndef LINESEARCH_H
+#define LINESEARCH_H
+
+#include <stdint.h>
+
+/// Result of an update of the line search
+enum class LineSearchStatus : uint8_t
+{
+    Searching, // The line was not found yet and the budget is not exhausted
+    Found, // The line is under the middle sensors again
+    Failed // The time or angle budget was exhausted, the motors were left turning
+};
+
+/// Sweep left and right in place with a growing amplitude around the heading where the line was lost, until the
+/// middle sensors find the line again. The first sweep goes towards where the line was last going, and the search
+/// gives up once the sweeps would go further than the angle budget or once the time budget is exhausted.
+/// The angle is estimated from the time spent rotating and the calibrated 90 degree rotation timings
+class LineSearch
+{
+public:
+    /// Constructor
+    LineSearch();
+
+    /// Start searching for the line. The motors are kickstarted by the motion queue, so the sensors can be read right away
+    /// \param lastLineError            The last line error before the line was lost (positive when the line was on the right)
+    /// \param lastLineErrorVariation   The variation of the line error over the last read of the sensors before the line was lost
+    /// \param lastSeenSideIsRight      Whether the line was last seen by the right edge sensor, used when the errors are zero
+    void start(int8_t lastLineError, int8_t lastLineErrorVariation, bool lastSeenSideIsRight);
+
+    /// Update the search with the latest line tracker readings. To be called on every read of the sensors while searching
+    /// \param lineTrackerValues The latest line tracker readings
+    /// \return The status of the search
+    LineSearchStatus update(uint8_t lineTrackerValues);
+
+private:
+    /// Start sweeping towards one side, up to the amplitude of the current sweep, without waiting for the motor pulse
+    /// \param isClockwise The direction of the sweep
+    void startSweep(bool isClockwise);
+
+    uint16_t m_msStart;
+    uint16_t m_msLastUpdate;
+    int16_t m_msRotation; // Rotation since the line was lost, in milliseconds at the calibrated rotation speed, positive clockwise
+    int16_t m_msSweepAmplitude; // Rotation from the heading where the line was lost at which the current sweep ends
+    int16_t m_msSweepAmplitudeIncrement;
+    int16_t m_msMaxSweepAmplitude;
+    bool m_isTurningClockwise;
+};
+
+#endif // LINESEARCH_H
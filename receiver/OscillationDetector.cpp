@@ -0,0 +1,152 @@
+/// Detection of the robot weaving around the line, to damp the tracking until it is stable again
+/// \file OscillationDetector.cpp
+/// \author Misha Krieger-Raynauld (1952515), Simon Gauvin (1951457), Vlad Drelciuc (1941366), Nicolas Charron (1960356)
+/// \date 2019-04-08
+
+#include "OscillationDetector.h"
+#include "LineErrors.h"
+#include "Timer.h"
+
+namespace
+{
+    // Smallest absolute error at the peaks of an oscillation, below which the robot is only wobbling on the middle sensor
+    constexpr uint8_t minOscillationAmplitude = 2;
+
+    // Longest half period of an oscillation. Slower changes of side are corrections of curves
+    constexpr uint16_t msMaxHalfPeriod = 500;
+
+    // Time the error must stay below the amplitude of an oscillation for the robot to be stable again
+    constexpr uint16_t msStableDuration = 600;
+} // namespace
+
+OscillationDetector::OscillationDetector()
+    : m_amplitudes()
+    , m_msHalfPeriods()
+    , m_nextIndex(0)
+    , m_nbHalfPeriods(0)
+    , m_currentAmplitude(0)
+    , m_msLastCrossing(0)
+    , m_msLastLargeError(0)
+    , m_isErrorPositive(false)
+    , m_hasErrorSide(false)
+    , m_isDamping(false)
+    , m_interventions()
+    , m_nbInterventions(0)
+{
+}
+
+void OscillationDetector::reset()
+{
+    m_nextIndex = 0;
+    m_nbHalfPeriods = 0;
+    m_currentAmplitude = 0;
+    m_hasErrorSide = false;
+    if (m_isDamping == true)
+    {
+        m_interventions[0].msDuration = lib::getMilliseconds() - m_interventions[0].msStart;
+        m_isDamping = false;
+    }
+}
+
+bool OscillationDetector::update(int8_t lineError)
+{
+    uint16_t msNow = lib::getMilliseconds();
+
+    // Errors on the middle sensor or without the line do not tell on which side the robot is
+    if (lineError != lineNotFoundError && lineError != 0)
+    {
+        bool isErrorPositive = lineError > 0;
+        uint8_t absoluteError = isErrorPositive ? lineError : -lineError;
+
+        if (absoluteError >= minOscillationAmplitude)
+        {
+            m_msLastLargeError = msNow;
+        }
+
+        if (m_hasErrorSide == false)
+        {
+            m_isErrorPositive = isErrorPositive;
+            m_hasErrorSide = true;
+            m_msLastCrossing = msNow;
+            m_currentAmplitude = absoluteError;
+        }
+        else if (isErrorPositive != m_isErrorPositive)
+        {
+            // A slow change of side interrupts the oscillation, only the half periods after it count
+            uint16_t msHalfPeriod = msNow - m_msLastCrossing;
+            if (msHalfPeriod > msMaxHalfPeriod)
+            {
+                m_nextIndex = 0;
+                m_nbHalfPeriods = 0;
+            }
+            else
+            {
+                m_amplitudes[m_nextIndex] = m_currentAmplitude;
+                m_msHalfPeriods[m_nextIndex] = msHalfPeriod;
+                if (++m_nextIndex == nbHalfPeriods)
+                {
+                    m_nextIndex = 0;
+                }
+                if (m_nbHalfPeriods < nbHalfPeriods)
+                {
+                    m_nbHalfPeriods++;
+                }
+            }
+
+            m_isErrorPositive = isErrorPositive;
+            m_msLastCrossing = msNow;
+            m_currentAmplitude = absoluteError;
+        }
+        else if (absoluteError > m_currentAmplitude)
+        {
+            m_currentAmplitude = absoluteError;
+        }
+    }
+
+    // Stop damping once the error stayed small for long enough, and forget the oscillation
+    if (m_isDamping == true)
+    {
+        if (static_cast<uint16_t>(msNow - m_msLastLargeError) >= msStableDuration)
+        {
+            m_interventions[0].msDuration = msNow - m_interventions[0].msStart;
+            m_isDamping = false;
+            m_nextIndex = 0;
+            m_nbHalfPeriods = 0;
+        }
+        return m_isDamping;
+    }
+
+    // The robot is oscillating when all of the last half periods were short and large
+    if (m_nbHalfPeriods == nbHalfPeriods)
+    {
+        uint8_t amplitude = UINT8_MAX;
+        uint16_t msPeriod = 0;
+        for (uint8_t i = 0; i < nbHalfPeriods; i++)
+        {
+            if (m_amplitudes[i] < amplitude)
+            {
+                amplitude = m_amplitudes[i];
+            }
+            msPeriod += m_msHalfPeriods[i];
+        }
+
+        if (amplitude >= minOscillationAmplitude)
+        {
+            // Record the intervention, the most recent first
+            for (uint8_t i = nbRecordedInterventions - 1; i > 0; i--)
+            {
+                m_interventions[i] = m_interventions[i - 1];
+            }
+            m_interventions[0] = {msNow, 0, static_cast<uint16_t>(msPeriod / (nbHalfPeriods / 2)), amplitude};
+            m_nbInterventions++;
+            m_isDamping = true;
+        }
+    }
+
+    return m_isDamping;
+}
+
+const OscillationIntervention& OscillationDetector::getIntervention(uint8_t index) const
+{
+    return m_interventions[index];
+}
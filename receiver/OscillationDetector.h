@@ -0,0 +1,71 @@
+/// Detection of the robot weaving around the line, to damp the tracking until it is stable again
+/// \file OscillationDetector.h
+/// \author Misha Krieger-Raynauld (1952515), Simon Gauvin (1951457), Vlad Drelciuc (1941366), Nicolas Charron (1960356)
+/// \date 2019-04-08
+
+#ifndef OSCILLATIONDETECTOR_H
+#define OSCILLATIONDETECTOR_H
+
+#include <stdint.h>
+
+/// Record of a damping of the tracking, for later analysis
+struct OscillationIntervention
+{
+    uint16_t msStart; // Time from lib::getMilliseconds at which the oscillation was detected
+    uint16_t msDuration; // Time until the robot was stable again, or 0 while the damping goes on
+    uint16_t msPeriod; // Period of the oscillation when it was detected
+    uint8_t amplitude; // Smallest absolute line error at the peaks of the oscillation when it was detected
+};
+
+/// Watch the zero crossings of the line error. The robot is oscillating when the error changed sides on every one of the last
+/// few half periods, each short and each reaching a large error. The tracking must then be damped until the error stays small
+/// for some time. Every damping is recorded
+class OscillationDetector
+{
+public:
+    /// Number of interventions kept in the record, the most recent ones
+    static constexpr uint8_t nbRecordedInterventions = 4;
+
+    /// Constructor
+    OscillationDetector();
+
+    /// Forget the history of the line error and stop damping. The record of the interventions is kept
+    void reset();
+
+    /// Update the detector with the latest line error. To be called once per read of the sensors
+    /// \param lineError The latest line error, from getLineError, or lineNotFoundError
+    /// \return Whether the tracking must be damped
+    bool update(int8_t lineError);
+
+    /// Get whether the tracking must be damped
+    /// \return Whether the robot is oscillating or was until recently
+    bool isDamping() const { return m_isDamping; }
+
+    /// Get the number of interventions since the construction, including those no longer in the record
+    /// \return The number of interventions
+    uint16_t getNbInterventions() const { return m_nbInterventions; }
+
+    /// Get a recorded intervention
+    /// \param index The index of the intervention, 0 being the most recent. Must be lower than the number of
+    ///              interventions and than nbRecordedInterventions
+    /// \return The intervention
+    const OscillationIntervention& getIntervention(uint8_t index) const;
+
+private:
+    static constexpr uint8_t nbHalfPeriods = 4;
+
+    uint8_t m_amplitudes[nbHalfPeriods]; // Peak absolute error of each of the last half periods
+    uint16_t m_msHalfPeriods[nbHalfPeriods];
+    uint8_t m_nextIndex;
+    uint8_t m_nbHalfPeriods;
+    uint8_t m_currentAmplitude; // Peak absolute error since the last zero crossing
+    uint16_t m_msLastCrossing;
+    uint16_t m_msLastLargeError;
+    bool m_isErrorPositive;
+    bool m_hasErrorSide;
+    bool m_isDamping;
+    OscillationIntervention m_interventions[nbRecordedInterventions];
+    uint16_t m_nbInterventions;
+};
+
+#endif // OSCILLATIONDETECTOR_H
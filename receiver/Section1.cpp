@@ -7,9 +7,13 @@
 #include "Debug.h"
 #include "ExitConditions.h"
 #include "Infrared.h"
+#include "MotionModel.h"
 #include "Motors.h"
+#include "Odometry.h"
+#include "SpeedScheduler.h"
 #include "Timer.h"
 #include "TrackingAlgos.h"
+#include "TrackingProfiles.h"
 
 namespace
 {
@@ -17,6 +21,60 @@ namespace
     constexpr uint8_t fastSpeed = 150;
     constexpr uint8_t slowSpeed = 90;
 
+    // Arcs of the zigzags, taken at the average of the fast and slow speeds
+    constexpr int16_t zigZagSpeed = (fastSpeed + slowSpeed) / 2;
+    constexpr int16_t zigZagRadiusMm = 260;
+
+    // Speeds of the motions from the selected point back to S3, which no longer need the precision of the calibrated timings
+    // and go through the motion model instead
+    constexpr uint8_t gridExitSpeed = 200;
+    constexpr uint8_t gridExitRotationSpeed = 150;
+
+    // Speed limits for following S3 once the robot has left the point grid
+    constexpr SpeedLimits s3SpeedLimits = {120, 190, 200, 10};
+
+    // Geometry of the point grid for the odometry: spacing of the points (3 inches, as used to calibrate the motion model),
+    // and distance of the line tracker ahead of the center of rotation (5 inches, as used to calibrate the motor timings)
+    constexpr uint8_t pointSpacingMm = lib::calibrationDistanceMm;
+    constexpr uint8_t sensorToCenterOfRotationMm = 127;
+
+    /// Print the pose of the robot estimated by the odometry, in the point grid
+    void printOdometry()
+    {
+        DEBUG_PRINT("\tOdometry: x ");
+        DEBUG_PRINT_NUMBER(lib::getOdometryX());
+        DEBUG_PRINT(" mm, y ");
+        DEBUG_PRINT_NUMBER(lib::getOdometryY());
+        DEBUG_PRINT(" mm, heading ");
+        DEBUG_PRINT_NUMBER(lib::getOdometryHeading());
+        DEBUG_PRINT(" degrees\n");
+    }
+
+    // Duty cycle change per millisecond of the ramps of the timed straight moves, which replace the kickstart pulse and the
+    // reversed braking to reduce wheel slip. Accelerating and braking at the same rate makes the distance lost ramping up
+    // about the same as the one gained ramping down, so the timings calibrated at steady speed still hold
+    constexpr uint8_t straightSlewRate = 3;
+    constexpr uint16_t msStraightSettleDuration = 50;
+
+    /// Go straight for a calibrated duration, ramping the motors up and down instead of pulsing and force stopping them
+    /// \param dutyCycle   Duty cycle of both motors, negative values mean the robot goes backward
+    /// \param msDuration  Duration in milliseconds of the move, as measured at steady speed
+    void goStraightFor(int16_t dutyCycle, uint16_t msDuration)
+    {
+        lib::setMotorSlewRates(straightSlewRate, straightSlewRate);
+        lib::setMotorSpeed(dutyCycle, dutyCycle);
+        lib::msSleep(msDuration);
+
+        // Ramp down and let the robot settle before removing the limits
+        lib::setMotorSpeed(0, 0);
+        while (lib::getLeftMotorSpeed() != 0 || lib::getRightMotorSpeed() != 0)
+        {
+            lib::pollOdometry();
+        }
+        lib::setMotorSlewRates(0, 0);
+        lib::msSleep(msStraightSettleDuration);
+    }
+
     // Timing constant for zigzags
     constexpr uint16_t msZigTime = 300;
     constexpr uint16_t msZagTime = 240;
@@ -27,7 +85,7 @@ namespace
     uint8_t zig()
     {
         lib::pulseMotorsCounterclockwise();
-        lib::setMotorSpeed(slowSpeed, fastSpeed);
+        lib::setCurvature<zigZagSpeed, lib::getCurvature(-zigZagRadiusMm)>();
 
         lib::startTimer(static_cast<uint32_t>(lib::secTimerMultiplier) * msZigTime / 1000); // Start timer for zig time
         // Loop until timer is expired or a point is detected
@@ -49,7 +107,7 @@ namespace
     uint8_t zag()
     {
         lib::pulseMotorsClockwise();
-        lib::setMotorSpeed(fastSpeed, slowSpeed);
+        lib::setCurvature<zigZagSpeed, lib::getCurvature(zigZagRadiusMm)>();
         
         lib::startTimer(static_cast<uint32_t>(lib::secTimerMultiplier) * msZagTime / 1000); // Start timer for zag time
         // Loop until timer is expired or a point is detected
@@ -88,14 +146,14 @@ namespace
         }
 
         // Wait until all sensors are on black to stop
-        while (bothEdgeSensorsOnBlack() == false)
+        while (checkLineTracker<BothEdgeSensorsOnBlack>() == false)
         {
         }
         lib::forceStopMotors(50);
 
         // Move backwards until the robot is just behind the black line for proper timings
         lib::setMotorSpeed(-slowSpeed, -slowSpeed);
-        while (anyEdgeSensorOnBlack())
+        while (checkLineTracker<AnyEdgeSensorOnBlack>())
         {
         }
         lib::forceStopMotors();
@@ -107,9 +165,7 @@ namespace
     /// Advance a calibrated distance between 2 points
     void advanceByDistanceBetweenPoints()
     {
-        lib::goStraight(lib::calibratedTimingSpeed);
-        lib::msSleep(lib::msBetweenPointsDuration);
-        lib::forceStopMotors();
+        goStraightFor(lib::calibratedTimingSpeed, lib::msBetweenPointsDuration);
     }
 
     /// Realign the robot by analyzing the given sensor values to reorient it properly towards the next point
@@ -156,9 +212,7 @@ namespace
     void advanceSlightlyPastPoint()
     {
         lib::displayNumberOnTrackerLeds(0); // Turn off tracker LEDs as robot will now be leaving point and sensors will be above white
-        lib::goStraight(lib::calibratedTimingSpeed);
-        lib::msSleep(lib::msBetweenPointsDuration / 3); // Advance by a fraction of the time between two points
-        lib::forceStopMotors(100);
+        goStraightFor(lib::calibratedTimingSpeed, lib::msBetweenPointsDuration / 3); // Advance by a fraction of the distance between two points
     }
 
     /// Advance to the next point a certain number of times and realign each time
@@ -197,6 +251,13 @@ namespace
             }
             DEBUG_PRINT('\n');
 
+            // The line tracker is on a point, which corrects the drift of the odometry
+            if (lineTrackerValues != 0b00000)
+            {
+                lib::snapOdometryToGridNode(pointSpacingMm, sensorToCenterOfRotationMm);
+                printOdometry();
+            }
+
             // Realign sensor orientation
             DEBUG_PRINT("\tPoint found, realigning\n");
             reorientSensorsOnPoint(lineTrackerValues); // Provide given sensor values for analysis
@@ -214,16 +275,14 @@ namespace
     /// Use calibrated timing to center the robot's center of rotation on the point by moving forward by a hardcoded amount
     void centerRobotOnPoint()
     {
-        lib::goStraight(lib::calibratedTimingSpeed);
-        lib::msSleep(lib::msSensorToCenterOfRotationDuration);
-        lib::forceStopMotors();
+        goStraightFor(lib::calibratedTimingSpeed, lib::msSensorToCenterOfRotationDuration);
     }
 } // namespace
 
 void followSection1()
 {
     // Move forward until slightly past T
-    followLine(fastSpeed, 20, 40, 10, false, threeMiddleSensorsOnWhite);
+    followLine<Section1Start>(ThreeMiddleSensorsOnWhite());
     lib::forceStopMotors();
     lib::displayNumberOnTrackerLeds(0); // Turn off tracker LEDs while waiting for command
 
@@ -261,9 +320,7 @@ void followSection1()
 
     // Go forward by a hardcoded amount to align with the point grid
     DEBUG_PRINT("\tGoing forward until aligned with line P7-P8-P9\n");
-    lib::goStraight(lib::calibratedTimingSpeed);
-    lib::msSleep(lib::msSection1StartOffsetDuration + 150); // +150 to travel a bit more
-    lib::forceStopMotors();
+    goStraightFor(lib::calibratedTimingSpeed, lib::msSection1StartOffsetDuration + 150); // +150 to travel a bit more
     lib::msSleep(200);
 
     // Rotate 90 degrees counterclockwise to face the point grid
@@ -272,9 +329,7 @@ void followSection1()
     lib::msSleep(200);
     
     // Go backward a little bit in case the point was slightly overshot
-    lib::goStraight(-lib::calibratedTimingSpeed);
-    lib::msSleep(lib::msBetweenPointsDuration / 3);
-    lib::forceStopMotors();
+    goStraightFor(-lib::calibratedTimingSpeed, lib::msBetweenPointsDuration / 3);
     lib::msSleep(200); // Sleep a little after reversing
 
     // Rotate slightly left to compensate for the fact that advanceToNextPoint starts by zigzaging right
@@ -283,6 +338,7 @@ void followSection1()
     // Move until first point (P9) is encountered by the line tracker then realign sensors on it
     DEBUG_PRINT("\tGoing to start point (P9)\n");
     advanceToNextPoint(1, 10);
+    lib::resetOdometry(0, -sensorToCenterOfRotationMm); // P9 is the origin of the grid, which the robot faces along the y axis
     advanceSlightlyPastPoint();
     
     DEBUG_PRINT("\tStarting path to ");
@@ -350,6 +406,7 @@ void followSection1()
         break;
     }
     DEBUG_PRINT("\tReached point\n");
+    printOdometry();
 
     // Make low pitch sound for 3 seconds
     lib::startPiezo(45);
@@ -358,7 +415,7 @@ void followSection1()
 
     // Rotate 90 degrees clockwise
     DEBUG_PRINT("\tRotating 90 degrees clockwise\n");
-    lib::rotate90Clockwise();
+    lib::rotateByDegrees(90, gridExitRotationSpeed);
 
     // Make low pitch sound for 3 seconds
     lib::startPiezo(45);
@@ -368,35 +425,16 @@ void followSection1()
     // Move to be aligned with third column according to the selected point
     DEBUG_PRINT("\tMoving to be aligned with S3\n");
     uint8_t column = static_cast<uint8_t>(point) % 3; // Get column number, indexed from 0
-    switch (column)
-    {
-    case 0:
-        advanceByDistanceBetweenPoints();
-        // Fallthrough
-    case 1:
-        advanceByDistanceBetweenPoints();
-    case 2:
-        break;
-    }
+    lib::driveDistance((2 - column) * pointSpacingMm, gridExitSpeed);
 
     // Rotate counterclockwise to point up
-    lib::rotate90Counterclockwise();
+    lib::rotateByDegrees(-90, gridExitRotationSpeed);
 
-    // Move to be on P3 (first row) according to the selected point
-    int8_t row = static_cast<uint8_t>(point) / 3; // Get row number, indexed from 0
-    switch (row)
+    // Move to be on P3 (first row) according to the selected point, stopping slightly less than a point before it
+    uint8_t row = static_cast<uint8_t>(point) / 3; // Get row number, indexed from 0
+    if (row > 0)
     {
-    case 2:
-        advanceByDistanceBetweenPoints();
-        // Fallthrough
-    case 1:
-        // Advance by slightly less than a point
-        lib::goStraight(lib::calibratedTimingSpeed);
-        lib::msSleep(lib::msBetweenPointsDuration * 2 / 3);
-        lib::forceStopMotors();
-        // Fallthrough
-    case 0:
-        break;
+        lib::driveDistance((row - 1) * pointSpacingMm + pointSpacingMm * 2 / 3, gridExitSpeed);
     }
 
     DEBUG_PRINT("\tLeaving point grid\n");
@@ -411,12 +449,12 @@ void followSection1()
         {
             lib::goStraight(lib::calibratedTimingSpeed);
             lib::startTimer(static_cast<uint32_t>(lib::secTimerMultiplier) * lib::msBetweenPointsDuration / 1200);
-            while (lib::isTimerExpired == false && allSensorsOnWhite())
+            while (lib::isTimerExpired == false && checkLineTracker<AllSensorsOnWhite>())
             {
             }
             lib::forceStopMotors();
 
-            if (allSensorsOnWhite() == false)
+            if (checkLineTracker<AllSensorsOnWhite>() == false)
             {
                 break;
             }
@@ -424,17 +462,20 @@ void followSection1()
         // Rotate to be perpendicular to S3
         else if (i == 1)
         {
-            lib::pulseMotorsClockwise();
-            lib::setMotorSpeed(lib::calibratedRotationSpeed, -lib::calibratedRotationSpeed);
-            
-            lib::startTimer(static_cast<uint32_t>(lib::secTimerMultiplier) * lib::msRotate90ClockwiseDuration / 920);
-            while (lib::isTimerExpired == false)
+            // Queue the rotation to keep reading the sensors, and stop it as soon as S3 is seen so that the sensors stay on it
+            lib::queueMotorPulse(lib::calibratedRotationSpeed, -lib::calibratedRotationSpeed);
+            lib::queueMotorSpeed(lib::calibratedRotationSpeed, -lib::calibratedRotationSpeed,
+                                 static_cast<uint32_t>(lib::msRotate90ClockwiseDuration) * 1000 / 920);
+            while (lib::isMotionComplete() == false)
             {
-                if (allSensorsOnWhite() == false)
+                lib::pollOdometry();
+                if (checkLineTracker<AllSensorsOnWhite>() == false)
                 {
                     detectedBlackWhileTurning = true;
+                    break;
                 }
             }
+            // Cancels the rest of the rotation if it was stopped early
             lib::forceStopMotors(100);
         }
         // Go forward until S3 is detected and turn to realign
@@ -446,7 +487,7 @@ void followSection1()
                 lib::goStraight(fastSpeed);
                 // Start a timer for half a second in case the robot misses the line
                 lib::startTimer(lib::secTimerMultiplier / 2);
-                while (allSensorsOnWhite() && lib::isTimerExpired == false)
+                while (checkLineTracker<AllSensorsOnWhite>() && lib::isTimerExpired == false)
                 {
                 }
             }
@@ -462,9 +503,10 @@ void followSection1()
 
     // Follow S3 until realigned
     DEBUG_PRINT("\tReached S3\n");
-    followLine(fastSpeed, 100, 100, 10, true, middleSensorOnBlack);
+    followLine<Section1Realign>(MiddleSensorOnBlack());
     lib::forceStopMotors(100); // Force stop to prevent drifting
 
     // Follow S3 until corner C2 is reached
-    followLine(fastSpeed, 100, 100, 10, false, allSensorsOnWhite);
+    SpeedScheduler speedScheduler(s3SpeedLimits);
+    followLine<Section1Straight>(AllSensorsOnWhite(), &speedScheduler);
 }
\ No newline at end of file
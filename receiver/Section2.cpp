@@ -4,64 +4,83 @@
 /// \date 2019-03-22
 
 #include "Section2.h"
+#include "CourseMap.h"
 #include "Debug.h"
 #include "ExitConditions.h"
 #include "Motors.h"
+#include "SpeedScheduler.h"
 #include "Timer.h"
 #include "TrackingAlgos.h"
+#include "TrackingContext.h"
+#include "TrackingProfiles.h"
+
+namespace
+{
+    // Speed limits on the straight lines, between which the speed scheduler speeds up and slows down before curves
+    constexpr SpeedLimits straightLineSpeedLimits = {100, 190, 200, 10};
+
+    // Radius of the left turns onto the first curve and onto the second line, which take the robot through a wide arc
+    constexpr int16_t wideLeftTurnRadiusMm = -195;
+} // namespace
 
 void followSection2()
 {
-    static constexpr uint8_t fastSpeed = 150;
     static constexpr uint8_t slowSpeed = 100;
 
+    // Anticipate the curves with the map recorded on the first run of the section
+    CourseMap courseMap(2);
+    SpeedScheduler speedScheduler(straightLineSpeedLimits);
+    speedScheduler.setCourseMap(&courseMap);
+
+    // Carry the tracking state from one line following to the next. It restarts by itself after the manual turns
+    TrackingContext trackingContext;
+
     // Follow straight line for two seconds
-    lib::startTimer(lib::secTimerMultiplier * 2);
-    followLine(fastSpeed, 100, 100, 10, true, timerExpired);
+    followLine<Section2Realign>(trackingContext, Timeout<2000>(), &speedScheduler);
 
     // Straight line. Stop early to start curve in time
-    followLine(fastSpeed, 10, 20, 75, false, threeMiddleSensorsOnWhite);
+    followLine<Section2Straight>(trackingContext, ThreeMiddleSensorsOnWhite());
 
     // Turn left until aligned with first curve
-    lib::setMotorSpeed(50, 100);
+    lib::setCurvature<75, lib::getCurvature(wideLeftTurnRadiusMm)>();
     waitUntilSensorDetectsLine(2);
 
     // Follow curve until corner at the end of the curve
-    followLine(slowSpeed, 30, 70, 5, false, allSensorsOnWhite);
+    followLine<Section2Curve>(trackingContext, AllSensorsOnWhite());
 
     // Follow corner at the end of the curve by turning right
     followCorner(true);
 
     // Follow line for 2 seconds
-    lib::startTimer(lib::secTimerMultiplier * 2);
-    followLine(fastSpeed, 100, 100, 10, true, timerExpired);
+    followLine<Section2Realign>(trackingContext, Timeout<2000>(), &speedScheduler);
 
     // Follow straight line after 2 seconds correction above
-    followLine(fastSpeed, 20, 23, 100, false, threeMiddleSensorsOnWhite);
+    followLine<Section2StraightBeforeTurn>(trackingContext, ThreeMiddleSensorsOnWhite());
 
     // Turn left to align with second line at the end of the line
-    lib::setMotorSpeed(60, 120);
+    lib::setCurvature<90, lib::getCurvature(wideLeftTurnRadiusMm)>();
     waitUntilSensorDetectsLine(2);
 
     // Follow straight line for at least 2 seconds
-    lib::startTimer(lib::secTimerMultiplier * 2);
-    followLine(fastSpeed, 100, 100, 10, true, timerExpired);
+    followLine<Section2Realign>(trackingContext, Timeout<2000>(), &speedScheduler);
 
     // Follow straight line until curve
-    followLine(fastSpeed, 20, 23, 100, false, threeMiddleSensorsOnWhite);
+    followLine<Section2StraightBeforeTurn>(trackingContext, ThreeMiddleSensorsOnWhite());
 
-    // Turn left until aligned with second curve
-    lib::setMotorSpeed(0, slowSpeed);
+    // Turn left around the left wheel until aligned with second curve
+    lib::setCurvature<slowSpeed / 2, lib::getCurvature(-lib::wheelbaseMm / 2)>();
     waitUntilSensorDetectsLine(2);
     lib::forceStopMotors(100);
 
     // Follow curve for 2 seconds to realign in order to avoid the next ExitCondition triggering prematurely
-    lib::startTimer(lib::secTimerMultiplier * 2);    
-    followLine(slowSpeed, 40, 50, 30, false, timerExpired, true);
+    followLine<Section2SecondCurve>(trackingContext, Timeout<2000>());
 
     // Follow curve slowly until straight segment while preventing corrections to the left
-    followLine(slowSpeed, 40, 50, 30, false, firstSensorOnBlack, true);
+    followLine<Section2SecondCurve>(trackingContext, FirstSensorOnBlack());
 
     // Follow line until corner
-    followLine(fastSpeed, 40, 50, 10, false, allSensorsOnWhite);
+    followLine<Section2CornerApproach>(trackingContext, AllSensorsOnWhite(), &speedScheduler);
+
+    // Store the map if this was the first run of the section
+    courseMap.save();
 }
@@ -7,31 +7,38 @@
 #include "Debug.h"
 #include "ExitConditions.h"
 #include "Motors.h"
+#include "SpeedScheduler.h"
 #include "Timer.h"
 #include "TrackingAlgos.h"
+#include "TrackingContext.h"
+#include "TrackingProfiles.h"
 
 namespace
 {
+    // Speed limits for following the line after the line detection
+    constexpr SpeedLimits cornerApproachSpeedLimits = {120, 200, 100, 20};
+
     /// Detect the line number on which the robot was placed
     /// \return The line number, indexed from 1
     uint8_t detectLineNumber()
     {
-        static constexpr uint8_t speed = 140;
+        // Carry the tracking state from one line following to the next, as the robot keeps following the same line
+        TrackingContext trackingContext;
 
-        followLine(speed, 40, 70, 20, false, anyEdgeSensorOnBlack);
-        followLine(speed, 40, 70, 20, false, bothEdgeSensorsOnWhite);
+        followLine<Section3Detection>(trackingContext, AnyEdgeSensorOnBlack());
+        followLine<Section3Detection>(trackingContext, BothEdgeSensorsOnWhite());
 
         // Get time between first and second branch
-        uint16_t firstInterval = followLine(speed, 40, 70, 20, false, anyEdgeSensorOnBlack);
+        uint16_t firstInterval = followLine<Section3Detection>(trackingContext, AnyEdgeSensorOnBlack());
 
         // Read line tracker values
         uint8_t lineTrackerValues = lib::readLineTrackerValues();
 
         bool isRightBranchFirst = lib::isLineTrackerSensorOnBlack(lineTrackerValues, 4);
 
-        followLine(speed, 40, 70, 10, false, bothEdgeSensorsOnWhite);
+        followLine<Section3BranchExit>(trackingContext, BothEdgeSensorsOnWhite());
         
-        uint16_t secondInterval = followLine(speed, 40, 70, 20, false, anyEdgeSensorOnBlack);
+        uint16_t secondInterval = followLine<Section3Detection>(trackingContext, AnyEdgeSensorOnBlack());
 
         // If the first interval is way smaller than the second interval,
         // we know that the course is a longer one (#1 or #3)
@@ -91,7 +98,7 @@ namespace
 void followSection3()
 {
     // Follow line until T
-    followLine(165, 40, 50, 20, false, threeMiddleSensorsOnBlack);
+    followLine<Section3Start>(ThreeMiddleSensorsOnBlack());
     lib::forceStopMotors();
 
     DEBUG_PRINT("WAITING FOR BUTTON PRESS\n");
@@ -112,5 +119,6 @@ void followSection3()
     }
 
     // Follow line until corner
-    followLine(150, 10, 70, 20, false, allSensorsOnWhite);
+    SpeedScheduler speedScheduler(cornerApproachSpeedLimits);
+    followLine<Section3CornerApproach>(AllSensorsOnWhite(), &speedScheduler);
 }
@@ -7,11 +7,17 @@
 #include "Debug.h"
 #include "Motors.h"
 #include "ExitConditions.h"
+#include "FeatureClassifier.h"
+#include "SpeedScheduler.h"
 #include "Timer.h"
 #include "TrackingAlgos.h"
+#include "TrackingProfiles.h"
 
 namespace
 {
+    // Speed limits for following the line after the last rectangle
+    constexpr SpeedLimits cornerApproachSpeedLimits = {100, 170, 100, 20};
+
     /// Play the sound to make when entering or leaving a rectangle
     void playTwoConsecutiveShortSounds()
     {
@@ -27,19 +33,14 @@ namespace
 
 void followSection4()
 {
-    static constexpr uint8_t speed = 120;
-
     // Same behavior for the three rectangles
     static constexpr uint8_t nbRectangles = 3;
     for (uint8_t i = 0; i < nbRectangles; i++)
     {
         DEBUG_PRINT("\tEntering rectangle\n");
 
-        // Follow line before rectangle
-        followLine(speed, 20, 70, 20, false, threeMiddleSensorsOnBlack);
-
-        // Follow rectangle perpendicular edge
-        followLine(speed, 20, 70, 20, false, threeMiddleSensorsOnWhite);
+        // Follow line before rectangle and its perpendicular edge, without stopping at the edge
+        followLine<Section4Approach>(FeatureDetected<Feature::RectangleEntry>());
 
         // Follow inside rectangle, playing sounds on entry and exit
         playTwoConsecutiveShortSounds();
@@ -47,11 +48,12 @@ void followSection4()
         playTwoConsecutiveShortSounds();
 
         // Follow rectangle perpendicular edge
-        followLine(speed, 20, 70, 20, false, bothEdgeSensorsOnWhite);
+        followLine<Section4Approach>(BothEdgeSensorsOnWhite());
 
         DEBUG_PRINT("\tLeaving rectangle\n");
     }
 
     // Follow line until corner
-    followLine(speed, 20, 70, 20, false, allSensorsOnWhite);
+    SpeedScheduler speedScheduler(cornerApproachSpeedLimits);
+    followLine<Section4Approach>(AllSensorsOnWhite(), &speedScheduler);
 }
\ No newline at end of file
@@ -0,0 +1,140 @@
+/// Adaptive base speed for the tracking algorithms
+/// \file SpeedScheduler.cpp
+/// \author Misha Krieger-Raynauld (1952515), Simon Gauvin (1951457), Vlad Drelciuc (1941366), Nicolas Charron (1960356)
+/// \date 2019-04-02
+
+#include "SpeedScheduler.h"
+#include "CourseMap.h"
+#include "LineErrors.h"
+
+namespace
+{
+    // Absolute error used when the line is lost, bigger than any error of the error table
+    constexpr uint8_t lineNotFoundAbsoluteError = 5;
+
+    // Absolute error from which a growing error is considered the start of a curve
+    constexpr uint8_t minCurveAbsoluteError = 2;
+
+    // Maximum sum of squared errors over the stability window for the robot to be considered stable (e.g. a few 1's)
+    constexpr int16_t maxStableErrorSquareSum = 4;
+
+    // Maximum absolute difference between the wheel duty cycles for the robot to be considered going straight
+    constexpr int16_t maxStableWheelDifferential = 30;
+} // namespace
+
+SpeedScheduler::SpeedScheduler(const SpeedLimits& limits)
+    : m_limits(limits)
+    , m_courseMap(nullptr)
+    , m_speed(limits.minSpeed)
+    , m_accelerationRemainder(0)
+    , m_msLastUpdate(0)
+    , m_previousAbsoluteError(0)
+    , m_errorWindow()
+{
+}
+
+void SpeedScheduler::start(int16_t speed)
+{
+    if (speed < m_limits.minSpeed)
+    {
+        speed = m_limits.minSpeed;
+    }
+    else if (speed > m_limits.maxSpeed)
+    {
+        speed = m_limits.maxSpeed;
+    }
+    m_speed = speed;
+    m_accelerationRemainder = 0;
+    m_msLastUpdate = 0;
+    m_previousAbsoluteError = 0;
+    m_errorWindow.clear();
+
+    if (m_courseMap != nullptr)
+    {
+        m_courseMap->startTracking();
+    }
+}
+
+int16_t SpeedScheduler::update(const TrackerSample& sample, int16_t wheelDifferential)
+{
+    uint8_t lineTrackerValues = sample.lineTrackerValues;
+    uint16_t msElapsed = sample.msElapsed - m_msLastUpdate;
+    m_msLastUpdate = sample.msElapsed;
+
+    // Get what is known about the course ahead
+    CourseHint courseHint = CourseHint::None;
+    if (m_courseMap != nullptr)
+    {
+        m_courseMap->update(lineTrackerValues, wheelDifferential);
+        courseHint = m_courseMap->getHint();
+    }
+
+    int8_t lineError = getLineError(lineTrackerValues);
+    uint8_t absoluteError;
+    if (lineError == lineNotFoundError)
+    {
+        absoluteError = lineNotFoundAbsoluteError;
+    }
+    else
+    {
+        absoluteError = (lineError < 0) ? -lineError : lineError;
+    }
+    m_errorWindow.add(absoluteError);
+
+    if (wheelDifferential < 0)
+    {
+        wheelDifferential = -wheelDifferential;
+    }
+
+    // Brake if the error is growing, as it means the line has started to curve, or if the course map knows a curve is coming
+    if ((absoluteError >= minCurveAbsoluteError && absoluteError > m_previousAbsoluteError) ||
+        courseHint == CourseHint::CurveAhead)
+    {
+        brake(msElapsed);
+    }
+    // Accelerate faster on known straight lines, as the robot does not need to wait to be stable to know it can
+    else if (courseHint == CourseHint::Straight && absoluteError < minCurveAbsoluteError)
+    {
+        accelerate(m_limits.accelerationRate * 2, msElapsed);
+    }
+    // Accelerate if the robot has been stable on the line and is going straight
+    else if (m_errorWindow.full() && m_errorWindow.sumOfSquares() <= maxStableErrorSquareSum &&
+             wheelDifferential <= maxStableWheelDifferential)
+    {
+        accelerate(m_limits.accelerationRate, msElapsed);
+    }
+
+    m_previousAbsoluteError = absoluteError;
+    return m_speed;
+}
+
+void SpeedScheduler::brake(uint16_t msElapsed)
+{
+    // Halve the speed above the minimum speed every half-life, linearly within each half-life
+    int16_t speedAboveMin = m_speed - m_limits.minSpeed;
+    uint16_t msBrakingDuration = 2 * m_limits.msBrakingHalfLife;
+    if (msElapsed >= msBrakingDuration)
+    {
+        m_speed = m_limits.minSpeed;
+    }
+    else
+    {
+        int16_t decrease = static_cast<int32_t>(speedAboveMin) * msElapsed / msBrakingDuration;
+
+        // Finish braking once the remaining speed above the minimum speed is too small to be divided
+        m_speed = (decrease == 0 && msElapsed > 0) ? m_limits.minSpeed : m_speed - decrease;
+    }
+    m_accelerationRemainder = 0;
+}
+
+void SpeedScheduler::accelerate(uint16_t rate, uint16_t msElapsed)
+{
+    // Keep the fraction of the increase below one duty cycle for the next update, as the loops can be short
+    uint32_t increase = static_cast<uint32_t>(rate) * msElapsed + m_accelerationRemainder;
+    m_accelerationRemainder = increase % 1000;
+    m_speed += increase / 1000;
+    if (m_speed > m_limits.maxSpeed)
+    {
+        m_speed = m_limits.maxSpeed;
+    }
+}
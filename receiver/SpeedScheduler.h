@@ -0,0 +1,75 @@
+/// Adaptive base speed for the tracking algorithms
+/// \file SpeedScheduler.h
+/// \author Misha Krieger-Raynauld (1952515), Simon Gauvin (1951457), Vlad Drelciuc (1941366), Nicolas Charron (1960356)
+/// \date 2019-04-02
+
+#ifndef SPEEDSCHEDULER_H
+#define SPEEDSCHEDULER_H
+
+#include <stdint.h>
+#include "ExitConditions.h"
+#include "SlidingWindow.h"
+
+class CourseMap;
+
+/// Speed limits within which the speed scheduler may move the base speed, to be tuned per section
+struct SpeedLimits
+{
+    int16_t minSpeed; // Speed to brake towards when a curve is coming
+    int16_t maxSpeed; // Speed to accelerate towards while the robot is stable on a straight line
+    uint16_t accelerationRate; // Speed increase per second while the robot is stable
+    uint8_t msBrakingHalfLife; // While a curve is detected, the speed above minSpeed is halved every msBrakingHalfLife
+};
+
+/// Raise the base speed while the robot is stable on the line and cut it when the error starts growing,
+/// which is what happens at the start of a curve. With a course map, also brake before known curves
+/// and accelerate on known straight lines
+class SpeedScheduler
+{
+public:
+    /// Constructor
+    /// \param limits The speed limits of the section
+    explicit SpeedScheduler(const SpeedLimits& limits);
+
+    /// Restart scheduling from a given speed, clamped within the limits, and forget the error history
+    /// \param speed The speed from which to start
+    void start(int16_t speed);
+
+    /// Use a course map to anticipate the course. The map is updated by the scheduler on every loop
+    /// \param courseMap The course map of the section, or nullptr to only adjust the speed reactively
+    void setCourseMap(CourseMap* courseMap) { m_courseMap = courseMap; }
+
+    /// Update the base speed according to the latest tracking data. To be called once per tracking loop. The speed changes
+    /// according to the time elapsed since the previous update, so that it does not depend on the duration of the loops
+    /// \param sample               The latest sample of the tracking algorithm, whose time is counted from the call to start
+    /// \param wheelDifferential    The difference between the left and the right motor duty cycles
+    /// \return The new base speed
+    int16_t update(const TrackerSample& sample, int16_t wheelDifferential);
+
+    /// Get the current base speed
+    /// \return The current base speed
+    int16_t getSpeed() const { return m_speed; }
+
+private:
+    // Number of loops over which the stability of the robot is evaluated
+    static constexpr uint8_t nbStabilityLoops = 8;
+
+    /// Remove a fraction of the speed above the minimum speed for a smooth slowdown
+    /// \param msElapsed The time since the previous update
+    void brake(uint16_t msElapsed);
+
+    /// Increase the speed up to the maximum speed
+    /// \param rate      The speed increase per second
+    /// \param msElapsed The time since the previous update
+    void accelerate(uint16_t rate, uint16_t msElapsed);
+
+    SpeedLimits m_limits;
+    CourseMap* m_courseMap;
+    int16_t m_speed;
+    uint16_t m_accelerationRemainder;
+    uint16_t m_msLastUpdate;
+    uint8_t m_previousAbsoluteError;
+    lib::SlidingWindow<uint8_t, nbStabilityLoops, int16_t> m_errorWindow;
+};
+
+#endif // SPEEDSCHEDULER_H
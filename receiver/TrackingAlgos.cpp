@@ -9,169 +9,60 @@
 #include "Motors.h"
 #include "Timer.h"
 
-uint16_t followLine(int16_t speed, uint8_t initialTurnDifference, uint8_t maxTurnDifference, uint8_t msTurnCorrectionDelay,
-                    bool useEdgeSensors, bool (*exitConditionFunction)(), bool canOnlyTurnRight)
+namespace
 {
-    enum class State : uint8_t
+    /// Block the execution of the program until the desired sensor detects a line, see waitUntilSensorDetectsLine
+    /// \param sensorIndex      The index of the sensor which has to hit a line, indexed from 0
+    /// \param preferExactMatch Whether to wait for the match to be exact, see waitUntilSensorDetectsLine
+    /// \param statsRecorder    The recorder of the statistics of the caller, in which every read is counted as searching
+    /// \return The reason for which the wait ended
+    TrackingExitReason waitForSensor(uint8_t sensorIndex, bool preferExactMatch, TrackingStatsRecorder& statsRecorder)
     {
-        Searching,
-        OnLine,
-        TemporaryLeftSpeedUp,
-        TemporaryRightSpeedUp,
-        AbruptTurnLeft,
-        AbruptTurnRight
-    } robotState = State::OnLine;
-
-    lib::setMotorSpeed(speed, speed);
-
-    // Timer for the time spent inside the function
-    uint16_t timeFollowed = 0;
-
-    // Counter for how much to increase the correction with time
-    uint16_t correctionCounter = 0;
-
-    bool lastSeenSideIsRight = true;
-
-    while (true)
-    {
-        // Read line sensor
-        uint8_t lineTrackerValues = lib::readLineTrackerValues();
-
-        if (exitConditionFunction())
+        if (sensorIndex > 4)
         {
-            return timeFollowed;
+            DEBUG_PRINT("ERROR: INVALID SENSOR NUMBER\n");
+            return TrackingExitReason::InvalidArgument;
         }
 
-        // Emergency detection
-
-        // If robot sees nothing
-        if (allSensorsOnWhite())
-        {
-            robotState = State::Searching;
-        }
-        // If all the sensors except the leftmost one are on white
-        else if (useEdgeSensors == true && lineTrackerValues == 0b10000)
-        {
-            robotState = State::AbruptTurnLeft;
-        }
-        // If all the sensors except the rightmost one are on white
-        else if (useEdgeSensors == true && lineTrackerValues == 0b00001)
-        {
-            robotState = State::AbruptTurnRight;
-        }
+        uint8_t lineTrackerValues = lib::readLineTrackerValues();
+        statsRecorder.recordIteration(TrackingState::Searching);
 
-        // Remember which side was last seen
-        if (lib::isLineTrackerSensorOnBlack(lineTrackerValues, 4))
+        if (preferExactMatch == true)
         {
-            lastSeenSideIsRight = true;
-        }
-        else if (lib::isLineTrackerSensorOnBlack(lineTrackerValues, 0))
-        {
-            lastSeenSideIsRight = false;
-        }
+            // Remember if the given sensor was on black
+            bool wasSensorOnBlack = false;
 
-        switch (robotState)
-        {
-        case State::Searching:
-            // If robot is centered on line
-            if (lib::isLineTrackerSensorOnBlack(lineTrackerValues, 0))
-            {
-                lib::setMotorSpeed(speed, speed);
-                robotState = State::OnLine;
-            }
-            else if (lastSeenSideIsRight == true)
-            {
-                // Turn right
-                lib::setMotorSpeed(speed, -speed);
-            }
-            else
+            while (lineTrackerValues != (1 << (lib::nbLineTrackerSensors - 1 - sensorIndex)))
             {
-                lib::setMotorSpeed(-speed, speed);                
-            }
-            break;
-        case State::OnLine:
-            // Do nothing, unless sensor 2 is on white sensor 1 or 3 is detecting a line
-            if (lib::isLineTrackerSensorOnBlack(lineTrackerValues, 2) == false)
-            {
-                if (canOnlyTurnRight == false &&
-                    lib::isLineTrackerSensorOnBlack(lineTrackerValues, 1) &&
-                    lib::isLineTrackerSensorOnBlack(lineTrackerValues, 3) == false) // Check that opposite side sensor is not
-                                                                                    // also on for proper alignment with T's
+                // Detect if sensor is on black if it has never been
+                if (wasSensorOnBlack == false)
                 {
-                    robotState = State::TemporaryLeftSpeedUp;
-                }
-                else if (lib::isLineTrackerSensorOnBlack(lineTrackerValues, 3) &&
-                        lib::isLineTrackerSensorOnBlack(lineTrackerValues, 1) == false) // Check that opposite side sensor is not
-                                                                                        // also on for proper alignment with T's
-                {
-                    robotState = State::TemporaryRightSpeedUp;
-                }
-            }
-            break;
-        case State::TemporaryLeftSpeedUp: // Fallthrough because similar logic
-        case State::TemporaryRightSpeedUp:
-            // If robot is centered on line
-            if (lib::isLineTrackerSensorOnBlack(lineTrackerValues, 2))
-            {
-                correctionCounter = 0;
-                lib::setMotorSpeed(speed, speed);
-                robotState = State::OnLine;
-            }
-            else
-            {
-                // If correctionCounter (the amount of turn difference) + initial turn diff is bigger than max turn
-                if (correctionCounter + initialTurnDifference < maxTurnDifference)
-                {
-                    correctionCounter++;
+                    wasSensorOnBlack = lib::isLineTrackerSensorOnBlack(lineTrackerValues, sensorIndex);
                 }
 
-                if (robotState == State::TemporaryLeftSpeedUp)
+                // If the desired sensor was seen and it is no longer seen, the function must exit
+                if (wasSensorOnBlack && lib::isLineTrackerSensorOnBlack(lineTrackerValues, sensorIndex) == false)
                 {
-                    int16_t rightMotorSpeed = lib::getRightMotorSpeed();
-                    // Speed down left motor proportionate to the time spent in this state
-                    lib::setMotorSpeed(rightMotorSpeed - correctionCounter - initialTurnDifference, speed);
-                }
-                else
-                {
-                    int16_t leftMotorSpeed = lib::getLeftMotorSpeed();
-                    // Speed down right motor proportionate to the time spent in this state
-                    lib::setMotorSpeed(speed, leftMotorSpeed - correctionCounter - initialTurnDifference);
+                    return TrackingExitReason::InexactMatch;
                 }
+
+                lineTrackerValues = lib::readLineTrackerValues();
+                statsRecorder.recordIteration(TrackingState::Searching);
             }
-            break;
-        case State::AbruptTurnLeft:
-            if (lib::isLineTrackerSensorOnBlack(lineTrackerValues, 2))
-            {
-                robotState = State::OnLine;
-                lib::forceStopMotors();
-                lib::setMotorSpeed(speed, speed);
-            }
-            else
-            {
-                lib::setMotorSpeed(0, speed);
-            }
-            break;
-        case State::AbruptTurnRight:
-            if (lib::isLineTrackerSensorOnBlack(lineTrackerValues, 2))
-            {
-                robotState = State::OnLine;
-                lib::forceStopMotors();
-                lib::setMotorSpeed(speed, speed);
-            }
-            else
+        }
+        else
+        {
+            while (lib::isLineTrackerSensorOnBlack(lineTrackerValues, sensorIndex) == false)
             {
-                lib::setMotorSpeed(speed, 0);
+                lineTrackerValues = lib::readLineTrackerValues();
+                statsRecorder.recordIteration(TrackingState::Searching);
             }
-            break;
         }
-        // Delay by a certain amount of time to be able to count the time
-        lib::msSleep(msTurnCorrectionDelay);
-        timeFollowed += msTurnCorrectionDelay;
+        return TrackingExitReason::ExitCondition;
     }
-    return timeFollowed;
-}
+} // namespace
 
-void followRectangle()
+void followRectangle(TrackingStats* stats)
 {
     enum class State
     {
@@ -180,23 +71,32 @@ void followRectangle()
         TemporaryRightSpeedUp
     } robotState = State::InSquare;
 
+    TrackingStatsRecorder statsRecorder(stats);
+
     int16_t speed = 120;
     uint8_t initialTurnDifference = 20;
     uint8_t maxTurnDifference = 80;
     uint8_t turnCorrectionDelay = 20;
+    uint16_t turnDifferenceRate = 50;
 
     lib::setMotorSpeed(speed, speed);
 
-    // Counter for how much to increase the correction with time
-    uint16_t correctionCounter = 0;
+    // Start of the current correction, to increase the correction with the time spent in it
+    uint16_t msCorrectionStart = 0;
 
     while (true)
     {
-        // Read line sensor
-        uint8_t lineTrackerValues = lib::readLineTrackerValues();
-
-        if (bothEdgeSensorsOnBlack())
+        // Read line sensor once, the exit check and the tracking use the same sample
+        TrackerSample sample = {lib::readLineTrackerValues(), 0};
+        uint8_t lineTrackerValues = sample.lineTrackerValues;
+        statsRecorder.recordIteration(robotState == State::TemporaryLeftSpeedUp ? TrackingState::TemporaryLeftSpeedUp :
+                                      robotState == State::TemporaryRightSpeedUp ? TrackingState::TemporaryRightSpeedUp :
+                                                                                   TrackingState::OnLine,
+                                      getRectangleError(lineTrackerValues));
+
+        if (BothEdgeSensorsOnBlack()(sample))
         {
+            statsRecorder.finish(TrackingExitReason::ExitCondition);
             return;
         }
 
@@ -206,40 +106,41 @@ void followRectangle()
             if (lib::isLineTrackerSensorOnBlack(lineTrackerValues, 0))
             {
                 robotState = State::TemporaryRightSpeedUp;
+                msCorrectionStart = lib::getMilliseconds();
+                statsRecorder.recordCorrection();
             }
             else if (lib::isLineTrackerSensorOnBlack(lineTrackerValues, 4))
             {
-                robotState = State::TemporaryLeftSpeedUp;                
+                robotState = State::TemporaryLeftSpeedUp;
+                msCorrectionStart = lib::getMilliseconds();
+                statsRecorder.recordCorrection();
             }
             break;
         case State::TemporaryLeftSpeedUp: // Fallthrough because similar logic
         case State::TemporaryRightSpeedUp:
             // If robot is centered on line
-            if (bothEdgeSensorsOnWhite() == true)
+            if (BothEdgeSensorsOnWhite()(sample) == true)
             {
-                correctionCounter = 0;
                 lib::setMotorSpeed(speed, speed);
                 robotState = State::InSquare;
             }
             else
             {
-                // If timer (the amount of turn difference) + initial turn diff is bigger than max turn
-                if (correctionCounter + initialTurnDifference < maxTurnDifference)
-                {
-                    correctionCounter++;
-                }
+                // Increase the turn difference with the time spent in this state, up to the max turn difference
+                int16_t turnDifference = initialTurnDifference + getRampIncrease(turnDifferenceRate, lib::getMilliseconds() - msCorrectionStart,
+                                                                                 maxTurnDifference - initialTurnDifference);
 
                 if (robotState == State::TemporaryLeftSpeedUp)
                 {
                     int16_t rightMotorSpeed = lib::getRightMotorSpeed();
                     // Speed down left motor proportionate to the time spent in this state
-                    lib::setMotorSpeed(rightMotorSpeed - correctionCounter - initialTurnDifference, speed);
+                    lib::setMotorSpeed(rightMotorSpeed - turnDifference, speed);
                 }
                 else
                 {
                     int16_t leftMotorSpeed = lib::getLeftMotorSpeed();
                     // Speed down right motor proportionate to the time spent in this state
-                    lib::setMotorSpeed(speed, leftMotorSpeed - correctionCounter - initialTurnDifference);
+                    lib::setMotorSpeed(speed, leftMotorSpeed - turnDifference);
                 }
             }
             break;
@@ -248,13 +149,16 @@ void followRectangle()
     }
 }
 
-void followCorner(bool turnClockwise)
+void followCorner(bool turnClockwise, TrackingStats* stats)
 {
+    TrackingStatsRecorder statsRecorder(stats);
+
     // Go forward a little to overshoot corner
     lib::goStraight(lib::calibratedTimingSpeed);
     lib::msSleep(lib::msSensorToCenterOfRotationDuration / 2);
     lib::forceStopMotors();
-    
+    statsRecorder.recordIteration(TrackingState::OnLine);
+
     // Begin rotation
     static constexpr uint8_t rotationSpeed = 100;
     if (turnClockwise)
@@ -276,51 +180,17 @@ void followCorner(bool turnClockwise)
     lib::startTimer(lib::secTimerMultiplier / 2);
     while (lib::readLineTrackerValues() != 0 || lib::isTimerExpired == false)
     {
+        statsRecorder.recordIteration(TrackingState::Searching);
     }
-    
+
     // Rotate until exactly the middle sensor is back on the black line
-    waitUntilSensorDetectsLine(2, true);
+    TrackingExitReason exitReason = waitForSensor(2, true, statsRecorder);
     lib::forceStopMotors();
+    statsRecorder.finish(exitReason);
 }
 
-void waitUntilSensorDetectsLine(uint8_t sensorIndex, bool preferExactMatch)
+void waitUntilSensorDetectsLine(uint8_t sensorIndex, bool preferExactMatch, TrackingStats* stats)
 {
-    if (sensorIndex > 4)
-    {
-        DEBUG_PRINT("ERROR: INVALID SENSOR NUMBER\n");
-        return;
-    }
-
-    uint8_t lineTrackerValues = lib::readLineTrackerValues();
-    
-
-    if (preferExactMatch == true)
-    {
-        // Remember if the given sensor was on black
-        bool wasSensorOnBlack = false;
-        
-        while (lineTrackerValues != (1 << (lib::nbLineTrackerSensors - 1 - sensorIndex)))
-        {
-            // Detect if sensor is on black if it has never been
-            if (wasSensorOnBlack == false)
-            {
-                wasSensorOnBlack = lib::isLineTrackerSensorOnBlack(lineTrackerValues, sensorIndex);
-            }
-
-            // If the desired sensor was seen and it is no longer seen, the function must exit
-            if (wasSensorOnBlack && lib::isLineTrackerSensorOnBlack(lineTrackerValues, sensorIndex) == false)
-            {
-                break;
-            }
-            
-            lineTrackerValues = lib::readLineTrackerValues();
-        }
-    }
-    else
-    {
-        while (lib::isLineTrackerSensorOnBlack(lineTrackerValues, sensorIndex) == false)
-        {
-            lineTrackerValues = lib::readLineTrackerValues();
-        }
-    }
+    TrackingStatsRecorder statsRecorder(stats);
+    statsRecorder.finish(waitForSensor(sensorIndex, preferExactMatch, statsRecorder));
 }
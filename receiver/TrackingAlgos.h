@@ -7,30 +7,414 @@
 #define TRACKINGALGOS_H
 
 #include <stdint.h>
+#include "ExitConditions.h"
+#include "GainSchedule.h"
+#include "GeneralIo.h"
+#include "LineErrors.h"
+#include "LineEstimator.h"
+#include "LinePredictor.h"
+#include "LineSearch.h"
+#include "Motors.h"
+#include "OscillationDetector.h"
+#include "SpeedScheduler.h"
+#include "Timer.h"
+#include "TrackingContext.h"
+#include "TrackingProfiles.h"
+#include "TrackingStats.h"
 
-/// Algorithm for following a line. This function will block and return when stopCondition returns true
-/// \param speed                    The speed at which the robot must follow the line
-/// \param initialTurnDifference    The initial value at which the appropriate wheel slows down when the robot must correct itself
-/// \param maxTurnDifference        The maximum value at which the appropriate wheel slows down when the robot must correct itself
-///                                 If this parameter is equal or lower than initialTurnDifference, no progressive turning will take place
-/// \param turnCorrectionDelay      The delay between each read of the sensors. This will also affect the speed at which the progressive
-///                                 turning increases.
-/// \param useEdgeSensors           Use edges sensors for tracking the line. If this parameter is true, the robot will block the appropriate
-///                                 wheel to quickly go back on track.
-/// \param exitConditionFunction    A pointer to a function returning a bool. This function passed as param must contain the logic to
-///                                 determine when the algorithm ends.
-/// \param canOnlyTurnRight         Tells the function if the robot is only allowed to turn right. Useful for S2 second curve end detection.
-/// \return                         The time in milliseconds the robot followed the line
-uint16_t followLine(int16_t speed, uint8_t initialTurnDifference, uint8_t maxTurnDifference, uint8_t turnCorrectionDelay,
-                    bool useEdgeSensors, bool (*exitConditionFunction)(), bool canOnlyTurnRight = false);
+/// Time returned by followLine when the line was lost and could not be found again within the budget of the line search
+constexpr uint16_t lineLostTime = UINT16_MAX;
+
+/// Rate in duty cycle units per second at which the base speed moves to the speed of the profile when followLine continues
+/// a call made at another speed, see TrackingContext
+constexpr uint16_t speedTransitionRate = 500;
+
+/// Get the base speed while the robot oscillates around the line, see OscillationDetector. The gain schedule also lowers
+/// the corrections at the lower speed
+/// \param speed The base speed without damping
+/// \return The damped base speed, three quarters of the speed
+constexpr int16_t getDampedSpeed(int16_t speed)
+{
+    return speed - (speed >> 2);
+}
+
+/// Get the state in which the tracking statistics count the time spent in a state of the line following algorithm
+/// \param state The state of the line following algorithm
+/// \return The state for the statistics
+constexpr TrackingState getTrackingState(LineFollowingState state)
+{
+    switch (state)
+    {
+    case LineFollowingState::Searching:
+        return TrackingState::Searching;
+    case LineFollowingState::TemporaryLeftSpeedUp:
+        return TrackingState::TemporaryLeftSpeedUp;
+    case LineFollowingState::TemporaryRightSpeedUp:
+        return TrackingState::TemporaryRightSpeedUp;
+    case LineFollowingState::AbruptTurnLeft:
+    case LineFollowingState::AbruptTurnRight:
+        return TrackingState::AbruptTurn;
+    default:
+        return TrackingState::OnLine;
+    }
+}
+
+/// Get the progressive increase of a value after some time, e.g. the turn difference while correcting the trajectory
+/// \param rate         The rate of the increase, in units per second
+/// \param msElapsed    The time since the increase started, measured with the real clock
+/// \param maxIncrease  The maximum increase, e.g. the difference between the maximum and the initial turn differences
+/// \return The increase, between 0 and maxIncrease
+inline int16_t getRampIncrease(uint16_t rate, uint16_t msElapsed, int16_t maxIncrease)
+{
+    if (maxIncrease <= 0)
+    {
+        return 0;
+    }
+
+    uint32_t increase = static_cast<uint32_t>(rate) * msElapsed / 1000;
+    return (increase < static_cast<uint16_t>(maxIncrease)) ? increase : maxIncrease;
+}
+
+/// Algorithm for following a line, continuing where the previous call with the same context returned. Consecutive calls
+/// keep the state of the algorithm, the progression of the corrections and the history of the filters, and move smoothly
+/// to the speed of the new profile, so that switching the exit condition or the profile does not jolt the robot.
+/// See the overload without a context for the parameters
+/// \tparam Profile                 The tuning of the algorithm, see TrackingProfiles.h
+/// \param context                  The state of the algorithm, carried from one call to the next
+/// \param exitCondition            The condition which determines when the algorithm ends
+/// \param speedScheduler           Optional speed scheduler, which continues from the current speed. Default value is nullptr
+/// \param stats                    Optional statistics to fill during the run. Default value is nullptr
+/// \return                         The time in milliseconds the robot followed the line, or lineLostTime
+template <typename Profile, typename ExitCondition>
+uint16_t followLine(TrackingContext& context, ExitCondition exitCondition, SpeedScheduler* speedScheduler = nullptr,
+                    TrackingStats* stats = nullptr)
+{
+    using State = LineFollowingState;
+
+    TrackingStatsRecorder statsRecorder(stats);
+
+    // Continue from the state and the speed of the previous call, or restart on the line at the speed of the profile
+    bool isResuming = context.canResume();
+    if (isResuming == false)
+    {
+        context.reset();
+    }
+    State& robotState = context.state;
+
+    // Slow down while the robot weaves around the line, until it is stable again
+    OscillationDetector& oscillationDetector = context.oscillationDetector;
+
+    // Speed without the damping of the oscillations, and speed of the motors when the previous call returned
+    int16_t nominalSpeed = (isResuming == true) ? context.speed : Profile::speed;
+    int16_t resumedSpeed = (oscillationDetector.isDamping() == true) ? getDampedSpeed(nominalSpeed) : nominalSpeed;
+
+    if (speedScheduler != nullptr)
+    {
+        speedScheduler->start(nominalSpeed);
+        nominalSpeed = speedScheduler->getSpeed();
+    }
+    int16_t speed = (oscillationDetector.isDamping() == true) ? getDampedSpeed(nominalSpeed) : nominalSpeed;
+
+    // Turn differences of the profile scaled for the current speed, as they were tuned at the speed of the profile
+    int16_t initialTurnDifference = scheduleGain(Profile::initialTurnDifference, Profile::speed, speed);
+    int16_t maxTurnDifference = scheduleGain(Profile::maxTurnDifference, Profile::speed, speed);
+    uint16_t turnDifferenceRate = scheduleGain(Profile::turnDifferenceRate, Profile::speed, speed);
+
+    // Corrections and searches already set the motor speeds from the speed on every loop
+    if (isResuming == false || (robotState == State::OnLine && speed != resumedSpeed))
+    {
+        lib::setMotorSpeed(speed, speed);
+    }
+
+    // Timer for the time spent inside the function
+    uint16_t timeFollowed = 0;
+
+    // Start of the current correction, to increase the correction with the time spent in it
+    uint16_t& msCorrectionStart = context.msCorrectionStart;
+
+    bool& lastSeenSideIsRight = context.lastSeenSideIsRight;
+
+    // Where the line was and where it was going, to know where to search for it if it is lost
+    int8_t& lastLineError = context.lastLineError;
+    int8_t& lineErrorVariation = context.lineErrorVariation;
+    LineSearch& lineSearch = context.lineSearch;
+
+    // Line error at the time the next command takes effect, to compensate for the latency of the loop
+    static constexpr int8_t minPredictedCorrectionError = 2;
+    LinePredictor& linePredictor = context.linePredictor;
+
+    // Position of the line estimated from the sensors and the motor commands, to keep steering through short gaps
+    LineEstimator& lineEstimator = context.lineEstimator;
+
+    uint16_t msStart = lib::getMilliseconds();
+
+    // Speed from which the base speed moves to the speed of the profile, when resuming at another speed without a scheduler
+    int16_t transitionStartSpeed = nominalSpeed;
+
+    while (true)
+    {
+        // Read line sensor once, the exit condition and the tracking use the same sample
+        TrackerSample sample = {lib::readLineTrackerValues(), static_cast<uint16_t>(lib::getMilliseconds() - msStart)};
+        uint8_t lineTrackerValues = sample.lineTrackerValues;
+        int8_t lineError = getLineError(lineTrackerValues);
+        statsRecorder.recordIteration(getTrackingState(robotState), lineError);
+
+        if (exitCondition(sample))
+        {
+            context.suspend(nominalSpeed);
+            statsRecorder.finish(TrackingExitReason::ExitCondition);
+            return timeFollowed;
+        }
+        State previousRobotState = robotState;
+
+        int16_t wheelDifferential = lib::getLeftMotorSpeed() - lib::getRightMotorSpeed();
+
+        int16_t previousSpeed = speed;
+
+        // Speed up on straight lines and slow down before curves
+        if (speedScheduler != nullptr)
+        {
+            nominalSpeed = speedScheduler->update(sample, wheelDifferential);
+        }
+        // Move smoothly to the speed of the profile when continuing a call made at another speed
+        else if (nominalSpeed != Profile::speed)
+        {
+            if (Profile::speed > transitionStartSpeed)
+            {
+                nominalSpeed = transitionStartSpeed + getRampIncrease(speedTransitionRate, sample.msElapsed, Profile::speed - transitionStartSpeed);
+            }
+            else
+            {
+                nominalSpeed = transitionStartSpeed - getRampIncrease(speedTransitionRate, sample.msElapsed, transitionStartSpeed - Profile::speed);
+            }
+        }
+
+        // Damp the tracking while the robot oscillates
+        bool wasDamping = oscillationDetector.isDamping();
+        speed = (oscillationDetector.update(lineError) == true) ? getDampedSpeed(nominalSpeed) : nominalSpeed;
+        if (oscillationDetector.isDamping() == true && wasDamping == false)
+        {
+            statsRecorder.recordDamping();
+        }
+
+        if (speed != previousSpeed)
+        {
+            initialTurnDifference = scheduleGain(Profile::initialTurnDifference, Profile::speed, speed);
+            maxTurnDifference = scheduleGain(Profile::maxTurnDifference, Profile::speed, speed);
+            turnDifferenceRate = scheduleGain(Profile::turnDifferenceRate, Profile::speed, speed);
+
+            // Other states already set the motor speeds from the speed on every loop
+            if (robotState == State::OnLine)
+            {
+                lib::setMotorSpeed(speed, speed);
+            }
+        }
+
+        // Remember where the line is and where it is going
+        if (lineError != lineNotFoundError)
+        {
+            lineErrorVariation = lineError - lastLineError;
+            lastLineError = lineError;
+        }
+        int8_t predictedLineError = linePredictor.update(lineError, wheelDifferential);
+        lineEstimator.update(lineError, lib::getLeftMotorSpeed(), lib::getRightMotorSpeed());
+
+        // Emergency detection
+
+        // If robot sees nothing, steer towards where the line is estimated to be while the estimate is recent enough,
+        // and search for the line otherwise unless it is already being searched
+        if (AllSensorsOnWhite()(sample))
+        {
+            if (lineEstimator.isValid())
+            {
+                if (robotState == State::OnLine)
+                {
+                    if (Profile::canOnlyTurnRight == false && lineEstimator.getOffset() < 0)
+                    {
+                        robotState = State::TemporaryLeftSpeedUp;
+                    }
+                    else if (lineEstimator.getOffset() > 0)
+                    {
+                        robotState = State::TemporaryRightSpeedUp;
+                    }
+                }
+            }
+            else if (robotState != State::Searching)
+            {
+                lineSearch.start(lastLineError, lineErrorVariation, lastSeenSideIsRight);
+                robotState = State::Searching;
+            }
+        }
+        // If all the sensors except the leftmost one are on white
+        else if (Profile::useEdgeSensors == true && lineTrackerValues == 0b10000)
+        {
+            robotState = State::AbruptTurnLeft;
+        }
+        // If all the sensors except the rightmost one are on white
+        else if (Profile::useEdgeSensors == true && lineTrackerValues == 0b00001)
+        {
+            robotState = State::AbruptTurnRight;
+        }
+
+        // Remember which side was last seen
+        if (lib::isLineTrackerSensorOnBlack(lineTrackerValues, 4))
+        {
+            lastSeenSideIsRight = true;
+        }
+        else if (lib::isLineTrackerSensorOnBlack(lineTrackerValues, 0))
+        {
+            lastSeenSideIsRight = false;
+        }
+
+        switch (robotState)
+        {
+        case State::Searching:
+            switch (lineSearch.update(lineTrackerValues))
+            {
+            case LineSearchStatus::Found:
+                lib::setMotorSpeed(speed, speed);
+                robotState = State::OnLine;
+                break;
+            case LineSearchStatus::Failed:
+                lib::forceStopMotors();
+                context.reset();
+                statsRecorder.finish(TrackingExitReason::LineLost);
+                return lineLostTime;
+            case LineSearchStatus::Searching:
+                break;
+            }
+            break;
+        case State::OnLine:
+        {
+            bool isLineOnLeft;
+            bool isLineOnRight;
+            // Correct if sensor 2 is on white and sensor 1 or 3 is detecting a line
+            if (lib::isLineTrackerSensorOnBlack(lineTrackerValues, 2) == false)
+            {
+                isLineOnLeft = lib::isLineTrackerSensorOnBlack(lineTrackerValues, 1) &&
+                               lib::isLineTrackerSensorOnBlack(lineTrackerValues, 3) == false; // Check that opposite side sensor is not
+                                                                                               // also on for proper alignment with T's
+                isLineOnRight = lib::isLineTrackerSensorOnBlack(lineTrackerValues, 3) &&
+                                lib::isLineTrackerSensorOnBlack(lineTrackerValues, 1) == false;
+            }
+            // Otherwise, correct early if the line is predicted to have left sensor 2 by the next read.
+            // Only on a plain line, so that branches do not attract the robot
+            else
+            {
+                bool isPlainLine = lib::isLineTrackerSensorOnBlack(lineTrackerValues, 0) == false &&
+                                   lib::isLineTrackerSensorOnBlack(lineTrackerValues, 4) == false;
+                isLineOnLeft = isPlainLine && predictedLineError <= -minPredictedCorrectionError;
+                isLineOnRight = isPlainLine && predictedLineError >= minPredictedCorrectionError;
+            }
+
+            // Do not start correcting if the line is predicted to be back under sensor 2 by the next read
+            if (Profile::canOnlyTurnRight == false && isLineOnLeft && predictedLineError < 0)
+            {
+                robotState = State::TemporaryLeftSpeedUp;
+            }
+            else if (isLineOnRight && predictedLineError > 0)
+            {
+                robotState = State::TemporaryRightSpeedUp;
+            }
+            break;
+        }
+        case State::TemporaryLeftSpeedUp: // Fallthrough because similar logic
+        case State::TemporaryRightSpeedUp:
+            // If robot is centered on line, or will be by the next read so that the correction does not overshoot
+            if (lib::isLineTrackerSensorOnBlack(lineTrackerValues, 2) ||
+                (predictedLineError != lineNotFoundError &&
+                 ((robotState == State::TemporaryLeftSpeedUp && predictedLineError >= 0) ||
+                  (robotState == State::TemporaryRightSpeedUp && predictedLineError <= 0))))
+            {
+                lib::setMotorSpeed(speed, speed);
+                robotState = State::OnLine;
+            }
+            else
+            {
+                // Increase the turn difference with the time spent in this state, up to the max turn difference
+                int16_t turnDifference = initialTurnDifference + getRampIncrease(turnDifferenceRate, lib::getMilliseconds() - msCorrectionStart,
+                                                                                 maxTurnDifference - initialTurnDifference);
+
+                if (robotState == State::TemporaryLeftSpeedUp)
+                {
+                    int16_t rightMotorSpeed = lib::getRightMotorSpeed();
+                    // Speed down left motor proportionate to the time spent in this state
+                    lib::setMotorSpeed(rightMotorSpeed - turnDifference, speed);
+                }
+                else
+                {
+                    int16_t leftMotorSpeed = lib::getLeftMotorSpeed();
+                    // Speed down right motor proportionate to the time spent in this state
+                    lib::setMotorSpeed(speed, leftMotorSpeed - turnDifference);
+                }
+            }
+            break;
+        case State::AbruptTurnLeft:
+            if (lib::isLineTrackerSensorOnBlack(lineTrackerValues, 2))
+            {
+                robotState = State::OnLine;
+                lib::forceStopMotors();
+                lib::setMotorSpeed(speed, speed);
+            }
+            else
+            {
+                lib::setMotorSpeed(0, speed);
+            }
+            break;
+        case State::AbruptTurnRight:
+            if (lib::isLineTrackerSensorOnBlack(lineTrackerValues, 2))
+            {
+                robotState = State::OnLine;
+                lib::forceStopMotors();
+                lib::setMotorSpeed(speed, speed);
+            }
+            else
+            {
+                lib::setMotorSpeed(speed, 0);
+            }
+            break;
+        }
+
+        // Count the corrections of the trajectory and time them from their start
+        if (robotState != previousRobotState && robotState != State::OnLine && robotState != State::Searching)
+        {
+            msCorrectionStart = lib::getMilliseconds();
+            statsRecorder.recordCorrection();
+        }
+
+        // Delay by a certain amount of time to be able to count the time
+        lib::msSleep(Profile::msTurnCorrectionDelay);
+        timeFollowed += Profile::msTurnCorrectionDelay;
+    }
+    return timeFollowed;
+}
+
+/// Algorithm for following a line. This function will block and return when exitCondition returns true
+/// \tparam Profile                 The tuning of the algorithm, see TrackingProfiles.h
+/// \param exitCondition            The condition which determines when the algorithm ends, e.g. AllSensorsOnWhite() or
+///                                 Timeout<2000>(). It is evaluated on the same sample as the tracking on every read of the sensors
+///                                 and is inlined in the loop, see ExitConditions.h
+/// \param speedScheduler           Optional speed scheduler which adjusts the speed on every read of the sensors, starting from the
+///                                 speed of the profile. Default value is nullptr, which keeps the speed constant
+/// \param stats                    Optional statistics to fill during the run. Default value is nullptr
+/// \return                         The time in milliseconds the robot followed the line, or lineLostTime if the line was lost
+///                                 and could not be found again, in which case the motors are stopped
+template <typename Profile, typename ExitCondition>
+uint16_t followLine(ExitCondition exitCondition, SpeedScheduler* speedScheduler = nullptr, TrackingStats* stats = nullptr)
+{
+    TrackingContext context;
+    return followLine<Profile>(context, exitCondition, speedScheduler, stats);
+}
 
 /// Algorithm for staying inside a rectangle.
 /// Blocks until rectangle has been left by checking if both edge sensors are on black. Useful for section 4
-void followRectangle();
+/// \param stats Optional statistics to fill during the run. Default value is nullptr
+void followRectangle(TrackingStats* stats = nullptr);
 
 /// Algorithm for taking a sharp corner
 /// \param turnCounterclockwise The direction of the turn
-void followCorner(bool turnClockwise);
+/// \param stats                Optional statistics to fill during the run. Default value is nullptr
+void followCorner(bool turnClockwise, TrackingStats* stats = nullptr);
 
 /// Block the execution of the program until the desired sensor detects a line
 /// \param sensorIndex      The index of the sensor which has to hit a line, indexed from 0
@@ -39,6 +423,7 @@ void followCorner(bool turnClockwise);
 ///                         never happened and the sensor number is now no longer on black, the function will
 ///                         return true at that moment. Warning: this may cause undesirable overshoot for edge sensors.
 ///                         Useful for following corners. Default value is false
-void waitUntilSensorDetectsLine(uint8_t sensorIndex, bool preferExactMatch = false);
+/// \param stats            Optional statistics to fill during the wait. Default value is nullptr
+void waitUntilSensorDetectsLine(uint8_t sensorIndex, bool preferExactMatch = false, TrackingStats* stats = nullptr);
 
 #endif // TRACKINGALGOS_H
@@ -0,0 +1,61 @@
+/// State of the line following algorithm carried from one call of followLine to the next
+/// \file TrackingContext.cpp
+/// \author Misha Krieger-Raynauld (1952515), Simon Gauvin (1951457), Vlad Drelciuc (1941366), Nicolas Charron (1960356)
+/// \date 2019-04-08
+
+#include "TrackingContext.h"
+#include "Motors.h"
+#include "Timer.h"
+
+namespace
+{
+    // Maximum time between two calls for the second one to continue the first one. The exit conditions are checked on every
+    // read of the sensors and the calls are chained right away, so a longer delay means the robot did something else
+    constexpr uint16_t msMaxSuspendedDuration = 50;
+} // namespace
+
+TrackingContext::TrackingContext()
+    : state(LineFollowingState::OnLine)
+    , speed(0)
+    , msCorrectionStart(0)
+    , lastSeenSideIsRight(true)
+    , lastLineError(0)
+    , lineErrorVariation(0)
+    , lineSearch()
+    , linePredictor()
+    , lineEstimator()
+    , oscillationDetector()
+    , isSuspended(false)
+    , leftMotorSpeed(0)
+    , rightMotorSpeed(0)
+    , msSuspended(0)
+{
+}
+
+void TrackingContext::reset()
+{
+    state = LineFollowingState::OnLine;
+    msCorrectionStart = 0;
+    lastSeenSideIsRight = true;
+    lastLineError = 0;
+    lineErrorVariation = 0;
+    linePredictor.reset();
+    lineEstimator.reset();
+    oscillationDetector.reset();
+    isSuspended = false;
+}
+
+void TrackingContext::suspend(int16_t baseSpeed)
+{
+    speed = baseSpeed;
+    leftMotorSpeed = lib::getLeftMotorSpeed();
+    rightMotorSpeed = lib::getRightMotorSpeed();
+    msSuspended = lib::getMilliseconds();
+    isSuspended = true;
+}
+
+bool TrackingContext::canResume() const
+{
+    return isSuspended && static_cast<uint16_t>(lib::getMilliseconds() - msSuspended) <= msMaxSuspendedDuration &&
+           lib::getLeftMotorSpeed() == leftMotorSpeed && lib::getRightMotorSpeed() == rightMotorSpeed;
+}
@@ -0,0 +1,68 @@
+/// State of the line following algorithm carried from one call of followLine to the next
+/// \file TrackingContext.h
+/// \author Misha Krieger-Raynauld (1952515), Simon Gauvin (1951457), Vlad Drelciuc (1941366), Nicolas Charron (1960356)
+/// \date 2019-04-08
+
+#ifndef TRACKINGCONTEXT_H
+#define TRACKINGCONTEXT_H
+
+#include <stdint.h>
+#include "LineEstimator.h"
+#include "LinePredictor.h"
+#include "LineSearch.h"
+#include "OscillationDetector.h"
+
+/// States of the line following algorithm
+enum class LineFollowingState : uint8_t
+{
+    Searching,
+    OnLine,
+    TemporaryLeftSpeedUp,
+    TemporaryRightSpeedUp,
+    AbruptTurnLeft,
+    AbruptTurnRight
+};
+
+/// Controller state of followLine. When the same context is given to consecutive calls, a call continues where the previous
+/// one returned instead of restarting on the line at the speed of its profile, so that changing the exit condition or the
+/// profile does not jolt the robot. The context restarts by itself when the motors were changed between the calls or when
+/// the robot stopped following the line for too long, as the state then no longer describes the robot
+struct TrackingContext
+{
+    /// Constructor
+    TrackingContext();
+
+    /// Forget the state, so that the next call of followLine starts on the line at the speed of its profile
+    void reset();
+
+    /// Remember that followLine returned while still following the line, with the motors left running
+    /// \param baseSpeed The base speed of the call which returned
+    void suspend(int16_t baseSpeed);
+
+    /// Get whether the next call of followLine can continue where the previous one returned
+    /// \return Whether the context was suspended recently and the motors were not changed since
+    bool canResume() const;
+
+    LineFollowingState state;
+    int16_t speed; // Base speed without damping when the last call returned
+    uint16_t msCorrectionStart; // Start of the current correction, to increase the correction with the time spent in it
+    bool lastSeenSideIsRight;
+
+    // Where the line was and where it was going, to know where to search for it if it is lost
+    int8_t lastLineError;
+    int8_t lineErrorVariation;
+    LineSearch lineSearch;
+
+    // Filters keeping their history across calls
+    LinePredictor linePredictor;
+    LineEstimator lineEstimator;
+    OscillationDetector oscillationDetector;
+
+    // Motors and time when the last call returned, to know whether the robot did something else since
+    bool isSuspended;
+    int16_t leftMotorSpeed;
+    int16_t rightMotorSpeed;
+    uint16_t msSuspended;
+};
+
+#endif // TRACKINGCONTEXT_H
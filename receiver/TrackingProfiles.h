@@ -0,0 +1,88 @@
+/// Tuning profiles of the line following behaviors of every section, in a single place to retune them
+/// \file TrackingProfiles.h
+/// \author Misha Krieger-Raynauld (1952515), Simon Gauvin (1951457), Vlad Drelciuc (1941366), Nicolas Charron (1960356)
+/// \date 2019-04-04
+
+#ifndef TRACKINGPROFILES_H
+#define TRACKINGPROFILES_H
+
+#include <stdint.h>
+
+/// Tuning of followLine, given as a template parameter so that every profile gets its own tracking loop
+/// where the options are constants and the unused branches are removed by the compiler
+/// \tparam Speed                   The speed at which the robot must follow the line
+/// \tparam InitialTurnDifference   The initial value at which the appropriate wheel slows down when the robot must correct itself
+/// \tparam MaxTurnDifference       The maximum value at which the appropriate wheel slows down when the robot must correct itself.
+///                                 If this parameter is equal or lower than InitialTurnDifference, no progressive turning will take place
+/// \tparam MsTurnCorrectionDelay   The delay between each read of the sensors
+/// \tparam UseEdgeSensors          Use edges sensors for tracking the line. If this parameter is true, the robot will block the appropriate
+///                                 wheel to quickly go back on track. Default value is false
+/// \tparam CanOnlyTurnRight        Whether the robot is only allowed to turn right. Useful for S2 second curve end detection.
+///                                 Default value is false
+/// \tparam TurnDifferenceRate      The rate in duty cycle units per second at which the progressive turning increases, measured with
+///                                 the real clock so that it does not depend on the time taken by a read of the sensors. Default value
+///                                 is one unit per nominal read, the increase of the turn difference before it was measured with the clock
+template <int16_t Speed, uint8_t InitialTurnDifference, uint8_t MaxTurnDifference, uint8_t MsTurnCorrectionDelay,
+          bool UseEdgeSensors = false, bool CanOnlyTurnRight = false, uint16_t TurnDifferenceRate = 1000 / MsTurnCorrectionDelay>
+struct TrackingProfile
+{
+    static constexpr int16_t speed = Speed;
+    static constexpr uint8_t initialTurnDifference = InitialTurnDifference;
+    static constexpr uint8_t maxTurnDifference = MaxTurnDifference;
+    static constexpr uint8_t msTurnCorrectionDelay = MsTurnCorrectionDelay;
+    static constexpr bool useEdgeSensors = UseEdgeSensors;
+    static constexpr bool canOnlyTurnRight = CanOnlyTurnRight;
+    static constexpr uint16_t turnDifferenceRate = TurnDifferenceRate;
+};
+
+// Section 1
+
+/// Follow the start line until slightly past the T
+using Section1Start = TrackingProfile<150, 20, 40, 10>;
+
+/// Realign on S3 after the points, blocking a wheel when an edge sensor sees the line
+using Section1Realign = TrackingProfile<150, 100, 100, 10, true>;
+
+/// Follow S3 until corner C2
+using Section1Straight = TrackingProfile<150, 100, 100, 10>;
+
+// Section 2
+
+/// Follow the start of a straight line, blocking a wheel when an edge sensor sees the line
+using Section2Realign = TrackingProfile<150, 100, 100, 10, true>;
+
+/// Follow the first straight line with gentle corrections, stopping early to start the curve in time
+using Section2Straight = TrackingProfile<150, 10, 20, 75>;
+
+/// Follow the straight lines before the second line and the second curve
+using Section2StraightBeforeTurn = TrackingProfile<150, 20, 23, 100>;
+
+/// Follow the first curve until its corner
+using Section2Curve = TrackingProfile<100, 30, 70, 5>;
+
+/// Follow the second curve slowly while preventing corrections to the left
+using Section2SecondCurve = TrackingProfile<100, 40, 50, 30, false, true>;
+
+/// Follow the last line until the corner
+using Section2CornerApproach = TrackingProfile<150, 40, 50, 10>;
+
+// Section 3
+
+/// Follow the line until the T
+using Section3Start = TrackingProfile<165, 40, 50, 20>;
+
+/// Follow the branches to detect the line number
+using Section3Detection = TrackingProfile<140, 40, 70, 20>;
+
+/// Follow a branch until past it, reading the sensors more often to leave it sooner
+using Section3BranchExit = TrackingProfile<140, 40, 70, 10>;
+
+/// Follow the line until the corner
+using Section3CornerApproach = TrackingProfile<150, 10, 70, 20>;
+
+// Section 4
+
+/// Follow the lines between and around the rectangles, and until the corner
+using Section4Approach = TrackingProfile<120, 20, 70, 20>;
+
+#endif // TRACKINGPROFILES_H
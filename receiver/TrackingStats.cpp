@@ -0,0 +1,144 @@
+/// Statistics of a run of a tracking algorithm, to find where time is lost without a serial cable
+/// \file TrackingStats.cpp
+/// \author Misha Krieger-Raynauld (1952515), Simon Gauvin (1951457), Vlad Drelciuc (1941366), Nicolas Charron (1960356)
+/// \date 2019-04-07
+
+#include "TrackingStats.h"
+#include "Debug.h"
+#include "Timer.h"
+
+#ifdef DEBUG
+namespace
+{
+    // Totals of every run since the start of the section. The exit reason of the totals is unused, the runs which lost
+    // the line being counted instead
+    TrackingStats sectionStats;
+    uint16_t nbSectionRuns = 0;
+    uint16_t nbSectionLineLosses = 0;
+
+    /// Add the statistics of a run to the totals of the section
+    /// \param stats The statistics of the run
+    void addToSectionStats(const TrackingStats& stats)
+    {
+        sectionStats.msElapsed += stats.msElapsed;
+        sectionStats.nbIterations += stats.nbIterations;
+        for (uint8_t i = 0; i < nbTrackingStates; i++)
+        {
+            sectionStats.msInState[i] += stats.msInState[i];
+        }
+        if (stats.maxAbsoluteError > sectionStats.maxAbsoluteError)
+        {
+            sectionStats.maxAbsoluteError = stats.maxAbsoluteError;
+        }
+        sectionStats.nbCorrections += stats.nbCorrections;
+        sectionStats.nbDampings += stats.nbDampings;
+        nbSectionRuns++;
+        if (stats.exitReason == TrackingExitReason::LineLost)
+        {
+            nbSectionLineLosses++;
+        }
+    }
+} // namespace
+#endif
+
+TrackingStatsRecorder::TrackingStatsRecorder(TrackingStats* stats)
+    : m_stats(stats)
+    , m_msStart(lib::getMilliseconds())
+    , m_msLastIteration(m_msStart)
+{
+#ifdef DEBUG
+    // Always record in debug mode, for the totals of the section
+    if (m_stats == nullptr)
+    {
+        m_stats = &m_runStats;
+    }
+#endif
+    if (m_stats != nullptr)
+    {
+        *m_stats = TrackingStats();
+    }
+}
+
+void TrackingStatsRecorder::recordIteration(TrackingState state, int8_t lineError)
+{
+    if (m_stats == nullptr)
+    {
+        return;
+    }
+
+    uint16_t msNow = lib::getMilliseconds();
+    m_stats->msInState[static_cast<uint8_t>(state)] += msNow - m_msLastIteration;
+    m_msLastIteration = msNow;
+    m_stats->nbIterations++;
+
+    if (lineError != lineNotFoundError)
+    {
+        uint8_t absoluteError = (lineError < 0) ? -lineError : lineError;
+        if (absoluteError > m_stats->maxAbsoluteError)
+        {
+            m_stats->maxAbsoluteError = absoluteError;
+        }
+    }
+}
+
+void TrackingStatsRecorder::recordCorrection()
+{
+    if (m_stats != nullptr)
+    {
+        m_stats->nbCorrections++;
+    }
+}
+
+void TrackingStatsRecorder::recordDamping()
+{
+    if (m_stats != nullptr)
+    {
+        m_stats->nbDampings++;
+    }
+}
+
+void TrackingStatsRecorder::finish(TrackingExitReason exitReason)
+{
+    if (m_stats != nullptr)
+    {
+        m_stats->msElapsed = lib::getMilliseconds() - m_msStart;
+        m_stats->exitReason = exitReason;
+#ifdef DEBUG
+        addToSectionStats(*m_stats);
+#endif
+    }
+}
+
+#ifdef DEBUG
+void resetSectionTrackingStats()
+{
+    sectionStats = TrackingStats();
+    nbSectionRuns = 0;
+    nbSectionLineLosses = 0;
+}
+
+void printSectionTrackingStats()
+{
+    DEBUG_PRINT("\tTRACKING: ");
+    DEBUG_PRINT_NUMBER(sectionStats.msElapsed);
+    DEBUG_PRINT(" MS IN ");
+    DEBUG_PRINT_NUMBER(nbSectionRuns);
+    DEBUG_PRINT(" RUNS, ");
+    DEBUG_PRINT_NUMBER(sectionStats.nbIterations);
+    DEBUG_PRINT(" READS, ");
+    DEBUG_PRINT_NUMBER(nbSectionLineLosses);
+    DEBUG_PRINT(" LINE LOSSES\n\tMS ON LINE / LEFT / RIGHT / ABRUPT / SEARCHING:");
+    for (uint8_t i = 0; i < nbTrackingStates; i++)
+    {
+        DEBUG_PRINT(' ');
+        DEBUG_PRINT_NUMBER(sectionStats.msInState[i]);
+    }
+    DEBUG_PRINT("\n\tMAX ERROR: ");
+    DEBUG_PRINT_NUMBER(sectionStats.maxAbsoluteError);
+    DEBUG_PRINT(", CORRECTIONS: ");
+    DEBUG_PRINT_NUMBER(sectionStats.nbCorrections);
+    DEBUG_PRINT(", DAMPINGS: ");
+    DEBUG_PRINT_NUMBER(sectionStats.nbDampings);
+    DEBUG_PRINT('\n');
+}
+#endif
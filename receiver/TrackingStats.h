@@ -0,0 +1,87 @@
+/// Statistics of a run of a tracking algorithm, to find where time is lost without a serial cable
+/// \file TrackingStats.h
+/// \author Misha Krieger-Raynauld (1952515), Simon Gauvin (1951457), Vlad Drelciuc (1941366), Nicolas Charron (1960356)
+/// \date 2019-04-07
+
+#ifndef TRACKINGSTATS_H
+#define TRACKINGSTATS_H
+
+#include <stdint.h>
+#include "LineErrors.h"
+
+/// States of the tracking algorithms for which the time spent is measured
+enum class TrackingState : uint8_t
+{
+    OnLine, // Going straight on the line (or inside the rectangle)
+    TemporaryLeftSpeedUp, // Correcting towards the left
+    TemporaryRightSpeedUp, // Correcting towards the right
+    AbruptTurn, // Blocking a wheel to turn back onto the line
+    Searching // Looking for the line (or rotating towards it)
+};
+constexpr uint8_t nbTrackingStates = 5;
+
+/// Reason for which a tracking algorithm returned
+enum class TrackingExitReason : uint8_t
+{
+    None, // The algorithm did not return yet
+    ExitCondition, // The exit condition of the algorithm was met
+    LineLost, // The line was lost and could not be found again
+    InexactMatch, // The sensor passed over the line without an exact match (waitUntilSensorDetectsLine)
+    InvalidArgument // The algorithm was called with invalid arguments
+};
+
+/// Statistics of a run of a tracking algorithm
+struct TrackingStats
+{
+    uint16_t msElapsed; // Measured with the real clock
+    uint16_t nbIterations; // Number of reads of the sensors
+    uint16_t msInState[nbTrackingStates]; // Indexed by TrackingState
+    uint8_t maxAbsoluteError; // Biggest absolute line error seen while the line was found
+    uint16_t nbCorrections; // Number of times the algorithm started correcting its trajectory
+    uint8_t nbDampings; // Number of times the algorithm started damping an oscillation, see OscillationDetector
+    TrackingExitReason exitReason;
+};
+
+/// Fill optional tracking statistics during a run of a tracking algorithm. Does nothing when no statistics are requested,
+/// except in debug mode where every run is also added to the totals of the section (see printSectionTrackingStats)
+class TrackingStatsRecorder
+{
+public:
+    /// Constructor. Resets the statistics and starts measuring the elapsed time
+    /// \param stats The statistics to fill, or nullptr
+    explicit TrackingStatsRecorder(TrackingStats* stats);
+
+    /// Record a read of the sensors. The time since the previous read is counted in the given state
+    /// \param state        The state of the algorithm since the previous read
+    /// \param lineError    The line error of the read, or lineNotFoundError if it is unknown
+    void recordIteration(TrackingState state, int8_t lineError = lineNotFoundError);
+
+    /// Record the start of a correction of the trajectory
+    void recordCorrection();
+
+    /// Record the start of a damping of an oscillation
+    void recordDamping();
+
+    /// Record the end of the run
+    /// \param exitReason The reason for which the algorithm returns
+    void finish(TrackingExitReason exitReason);
+
+private:
+    TrackingStats* m_stats;
+    uint16_t m_msStart;
+    uint16_t m_msLastIteration;
+#ifdef DEBUG
+    TrackingStats m_runStats; // Statistics of the run when the caller did not request them
+#endif
+};
+
+#ifdef DEBUG
+    /// Reset the totals of the statistics of the tracking algorithms, at the start of a section
+    void resetSectionTrackingStats();
+
+    /// Print the totals of the statistics of the tracking algorithms since resetSectionTrackingStats
+    /// Note: requires initializeUsart() to have been called beforehand
+    void printSectionTrackingStats();
+#endif
+
+#endif // TRACKINGSTATS_H
@@ -4,10 +4,14 @@
 /// \date 2019-03-22
 
 #include "Adc.h"
+#include "CourseMap.h"
 #include "Debug.h"
 #include "ExitConditions.h"
 #include "ExternalMemory.h"
 #include "Infrared.h"
+#include "MotionModel.h"
+#include "MotorBenchmark.h"
+#include "Odometry.h"
 #include "Motors.h"
 #include "Section1.h"
 #include "Section2.h"
@@ -15,6 +19,7 @@
 #include "Section4.h"
 #include "Timer.h"
 #include "TrackingAlgos.h"
+#include "TrackingStats.h"
 #include "Usart.h"
 
 int main()
@@ -23,6 +28,7 @@ int main()
     lib::initializePins();
     lib::initializePiezo();
     lib::initializeTimer();
+    lib::startMillisecondClock();
     lib::initializeUsart();
     lib::initializeMotors();
 
@@ -43,12 +49,40 @@ int main()
             }
         #endif
 
-        // Automatic motor timings calibration
-        lib::calibrateMotorTimings();
+        // Automatic motor curves, motor timings and motion model calibration. The curves come first, as the others
+        // depend on how straight the robot goes
+        lib::calibrateMotorCurves();
+
+        // Press the button once to calibrate the timings on the calibration sheet, twice to place the robot for each test,
+        // or three times to benchmark the PWM modes of the motors instead of calibrating the timings
+        DEBUG_PRINT("PRESS ONCE FOR THE CALIBRATION SHEET, TWICE TO PLACE THE ROBOT FOR EACH TEST, THREE TIMES FOR THE PWM BENCHMARK\n");
+        uint8_t buttonPressCount = lib::getButtonPressCount();
+        if (buttonPressCount == 3)
+        {
+            lib::benchmarkAllMotorPwmModes();
+        }
+        else
+        {
+            if (buttonPressCount == 1)
+            {
+                lib::calibrateMotorTimingsInOnePass();
+            }
+            else
+            {
+                lib::calibrateMotorTimings();
+            }
+            lib::calibrateMotionModel();
+
+            // Record the course maps again, as they depend on the motor behavior
+            CourseMap::eraseAll();
+        }
     }
 
-    // Read motor calibration timings back from EEPROM
+    // Read motor curves, calibration timings and motion model back from EEPROM
+    lib::readMotorCurves();
     lib::readMotorTimings();
+    lib::readMotionModel();
+    lib::initializeOdometry();
 
     // Test motor calibration if calibration pin is still connected
     while (PINB & lib::calibrationMask)
@@ -107,6 +141,13 @@ int main()
     // Cycle through sections
     for (uint8_t i = 0; i < static_cast<uint8_t>(Section::Count); i++)
     {
+        // Measure the time lost in forced stops and the statistics of the tracking in each section
+        #ifdef DEBUG
+            uint16_t msStopDurationAtStart = lib::getStopDuration();
+            uint16_t nbStopsAtStart = lib::getNbStops();
+            resetSectionTrackingStats();
+        #endif
+
         switch (section)
         {
         case Section::Section1:
@@ -135,6 +176,15 @@ int main()
             break;
         }
 
+        #ifdef DEBUG
+            DEBUG_PRINT("\tTIME SPENT STOPPING: ");
+            DEBUG_PRINT_NUMBER(static_cast<uint16_t>(lib::getStopDuration() - msStopDurationAtStart));
+            DEBUG_PRINT(" MS IN ");
+            DEBUG_PRINT_NUMBER(static_cast<uint16_t>(lib::getNbStops() - nbStopsAtStart));
+            DEBUG_PRINT(" STOPS\n");
+            printSectionTrackingStats();
+        #endif
+
         // Follow corner by turning left if this is not the last section
         if (i < static_cast<uint8_t>(Section::Count) - 1)
         {
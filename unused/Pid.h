@@ -1,134 +1,15 @@
-/// Get error between desired setpoint for following a line and the given line tracker sensor readings
-/// \param lineTrackerValues 8-bit unsigned int whose bit represents the line tracker sensor readings
-/// \return The error between the center and the current position for use with a PID controller.
-///         Positive values mean the robot is off course towards the left, negative towards the right.
-///         If the sensor values combination is unknown, -128 is returned
-int8_t getLineError(uint8_t lineTrackerValues)
-{
-    // Sensor values | Error
-    // 0 0 0 0 1     |  4
-    // 0 0 0 1 1     |  3
-    // 0 0 1 1 1     |  3
-    // 0 0 0 1 0     |  2
-    // 0 0 1 1 0     |  1
-    // 0 0 1 0 1     |  1
-    // 0 0 1 0 0     |  0
-    // 0 1 1 1 0     |  0
-    // 1 1 1 1 1     |  0
-    // 0 1 1 1 1     |  0
-    // 1 1 1 1 0     |  0
-    // 1 1 1 0 1     |  0
-    // 1 0 1 1 1     |  0
-    // 0 1 1 0 0     | -1
-    // 1 0 1 0 0     | -1
-    // 0 1 0 0 0     | -2
-    // 1 1 1 0 0     | -3
-    // 1 1 0 0 0     | -3
-    // 1 0 0 0 0     | -4
-
-    switch (lineTrackerValues)
-    {
-    case 0b00001:
-        return 4;
-        break;
-    case 0b00011:
-    case 0b00111:
-        return 3;
-        break;
-    case 0b00010:
-        return 2;
-        break;
-    case 0b00110:
-    case 0b00101:
-        return 1;
-        break;
-    case 0b00100:
-    case 0b01110:
-    case 0b11111:
-    case 0b01111:
-    case 0b11110:
-    case 0b11101:
-    case 0b10111:
-        return 0;
-        break;
-    case 0b01100:
-    case 0b10100:
-        return -1;
-        break;
-    case 0b01000:
-        return -2;
-        break;
-    case 0b11100:
-    case 0b11000:
-        return -3;
-        break;
-    case 0b10000:
-        return -4;
-        break;
-    default: // If no pattern was recognized, return -128 as a flag
-        return -128;
-        break;
-    }
-}
-
-/// Get error between desired setpoint for following a rectangle and the given line tracker sensor readings
-/// \param lineTrackerValues 8-bit unsigned int whose bit represents the line tracker sensor readings
-/// \return The error between the rectangle alignment and the current position for use with a PID controller.
-///         Positive values mean the robot is off course towards the left, negative towards the right.
-///         If the sensor values combination is unknown, -128 is returned
-int8_t getRectangleError(uint8_t lineTrackerValues)
-{
-    // Sensor values | Error
-    // 0 1 0 0 0     |  3
-    // 1 1 0 0 0     |  2
-    // 1 0 0 0 0     |  1
-    // 0 0 0 0 0     |  0
-    // 0 0 1 0 0     |  0
-    // 0 1 1 1 0     |  0
-    // 1 1 1 1 0     |  0
-    // 0 1 1 1 1     |  0
-    // 1 1 1 1 1     |  0
-    // 0 0 0 0 1     | -1
-    // 0 0 0 1 1     | -2
-    // 0 0 0 1 0     | -3
-
-    switch (lineTrackerValues)
-    {
-    case 0b01000:
-        return 3;
-        break;
-    case 0b11000:
-        return 2;
-        break;
-    case 0b10000:
-        return 1;
-        break;
-    case 0b00000:
-    case 0b00100:
-    case 0b01110:
-    case 0b11110:
-    case 0b01111:
-    case 0b11111:
-        return 0;
-        break;
-    case 0b00001:
-        return -1;
-        break;
-    case 0b00011:
-        return -2;
-        break;
-    case 0b00010:
-        return -3;
-        break;
-    default: // If no pattern was recognized, return -128 as a flag
-        return -128;
-        break;
-    }
-}
-
-// Follow with PID by providing an error calculation function and an exit condition function
+#include "GainSchedule.h"
+#include "LineErrors.h"
+#include "LinePredictor.h"
+#include "OscillationDetector.h"
+#include "SlidingWindow.h"
+
+// Follow with PID by providing an error calculation function and an exit condition (see ExitConditions.h).
+// If isPredictionEnabled, the PID acts on the error predicted for when the command takes effect (line errors only,
+// as the prediction expects turning right to move the error towards the left)
+template <typename ExitCondition>
 void pidFollow(int8_t (*errorCalculationFunction)(uint8_t lineTrackerValues),
-                bool (*exitConditionFunction)())
+                ExitCondition exitCondition, bool isPredictionEnabled)
 {
     // PID gain constants to tweak (Kp first, to make the robot follow the line, and then Kd for smoothing)
     // See first answer: https://robotics.stackexchange.com/questions/167/what-are-good-strategies-for-tuning-pid-loops
@@ -146,6 +27,11 @@ void pidFollow(int8_t (*errorCalculationFunction)(uint8_t lineTrackerValues),
     
     static constexpr uint8_t nbSlowDownCyclesOnError = 50;
     uint8_t slowDownCounter = 0;
+
+    // Gains scaled for the slowed down speed in curves, as Kp and Kd were tuned at baseSpeed
+    static constexpr int16_t slowedDownSpeed = baseSpeed - curveSlowDownValue;
+    static constexpr int16_t slowedDownKp = scheduleGain(Kp, baseSpeed, slowedDownSpeed);
+    static constexpr int16_t slowedDownKd = scheduleGain(Kd, baseSpeed, slowedDownSpeed);
     
     // Persistent PID variables
     int8_t previousError = 0;
@@ -158,18 +44,34 @@ void pidFollow(int8_t (*errorCalculationFunction)(uint8_t lineTrackerValues),
     // Reset logs
     robotLogs.clear();
 
+    // Running statistics over the last logs for the curve slow down heuristic. These are updated in
+    // constant time on every loop instead of iterating over every log, so the loop duration does not
+    // depend on the logger capacity. The squared error sum fits in 16 bits as the error is within [-4, 4]
+    static constexpr uint8_t nbLogsToAnalyze = 40;
+    lib::SlidingWindow<int8_t, nbLogsToAnalyze, int16_t> errorWindow;
+    lib::SlidingWindow<int16_t, nbLogsToAnalyze> pidWindow;
+
+    // Compensate for the latency of the loop
+    LinePredictor linePredictor;
+
+    // Slow down with the gains of the curves while the robot weaves around the line
+    OscillationDetector oscillationDetector;
+
+    uint16_t msStart = lib::getMilliseconds();
+
     while (true)
     {
-        // Read line tracker values
-        uint8_t lineTrackerValues = lib::readLineTrackerValues();
+        // Read line tracker values once, the exit condition uses the same sample
+        TrackerSample sample = {lib::readLineTrackerValues(), static_cast<uint16_t>(lib::getMilliseconds() - msStart)};
+        uint8_t lineTrackerValues = sample.lineTrackerValues;
         /*for (uint8_t i = 3; i < 8; i++)
         {
             DEBUG_PRINT(((lineTrackerValues << i) & 0x80) ? '1' : '0');
         }
         DEBUG_PRINT(" | ");*/
                 
-        // Exit function if the exitCondition function evaluates to true
-        if (exitConditionFunction())
+        // Exit function if the exit condition evaluates to true
+        if (exitCondition(sample))
         {
             DEBUG_PRINT("EXIT CONDITION\n");
             return;
@@ -177,7 +79,15 @@ void pidFollow(int8_t (*errorCalculationFunction)(uint8_t lineTrackerValues),
 
         // Error
         int8_t error = errorCalculationFunction(lineTrackerValues);
-        if (error == -128)
+        if (isPredictionEnabled)
+        {
+            error = linePredictor.update(error, lib::getLeftMotorSpeed() - lib::getRightMotorSpeed());
+        }
+        if (oscillationDetector.update(error) == true)
+        {
+            slowDownCounter = nbSlowDownCyclesOnError;
+        }
+        if (error == lineNotFoundError)
         {
             DEBUG_PRINT("FUCK\n");
             //lib::playShortPiezoSound();
@@ -188,7 +98,9 @@ void pidFollow(int8_t (*errorCalculationFunction)(uint8_t lineTrackerValues),
         int16_t P = error; // Proportional term
         I += error; // Add to integral term
         int16_t D = error - previousError; // Derivative term (change in error)
-        int16_t speedDifference = Kp * P + Ki * I + Kd * D; // PID control variable (sum of all terms multiplied by their gain)
+        int16_t currentKp = (slowDownCounter > 0) ? slowedDownKp : Kp; // Gains for the current speed
+        int16_t currentKd = (slowDownCounter > 0) ? slowedDownKd : Kd;
+        int16_t speedDifference = currentKp * P + Ki * I + currentKd * D; // PID control variable (sum of all terms multiplied by their gain)
         previousError = error; // Set previous error to current error for next loop
 
         // Print PID values
@@ -208,15 +120,9 @@ void pidFollow(int8_t (*errorCalculationFunction)(uint8_t lineTrackerValues),
         int16_t leftMotorSpeed = baseSpeed + speedDifference;
         int16_t rightMotorSpeed = baseSpeed - speedDifference;
 
-        // Calculate average error
-        int16_t errorSum = 0;
-        int32_t pidSum = 0;
-        static constexpr uint8_t nbLogsToAnalyze = 40;
-        for (const auto& log : robotLogs)
-        {
-            errorSum += log.error * log.error;
-            pidSum += log.pidSpeedDifference;
-        }
+        // Get error statistics over the last logs
+        int16_t errorSum = errorWindow.sumOfSquares();
+        int32_t pidSum = pidWindow.sum();
 
         DEBUG_PRINT_NUMBER(errorSum);
         DEBUG_PRINT(' ');
@@ -310,6 +216,8 @@ void pidFollow(int8_t (*errorCalculationFunction)(uint8_t lineTrackerValues),
             //D,
             speedDifference
         });
+        errorWindow.add(error);
+        pidWindow.add(speedDifference);
         // Log current loop actions
         if (logTimer >= msPerLog)
         {
@@ -325,12 +233,13 @@ void pidFollow(int8_t (*errorCalculationFunction)(uint8_t lineTrackerValues),
     // Useful source: https://www.instructables.com/id/Line-Follower-Robot-PID-Control-Android-Setup/
 }
 
-void pidFollowLine(bool (*exitConditionFunction)())
+template <typename ExitCondition>
+void pidFollowLine(ExitCondition exitCondition)
 {
-    pidFollow(getLineError, exitConditionFunction);
+    pidFollow(getLineError, exitCondition, true);
 }
 
 void pidFollowRectangle()
 {
-    pidFollow(getRectangleError, bothEdgeSensorsOnBlack);
+    pidFollow(getRectangleError, BothEdgeSensorsOnBlack(), false);
 }
\ No newline at end of file